@@ -0,0 +1,144 @@
+// TODO: Fix project include structure in src/CMakeLists.txt
+#include "../src/fourier_mellin.hpp"
+#include "synthetic_image.hpp"
+
+#include <iomanip>
+#include <chrono>
+
+template<typename Function>
+double measureSeconds(int iterations, Function&& function){
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for(int i=0; i<iterations; i++){
+        function();
+    }
+    auto endTime = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(endTime - startTime).count();
+}
+
+void benchmarkPadding(){
+    constexpr int iterations = 100;
+    const Transform t_01(-12, 7, 0.95, 8, 1);
+
+    // Sizes with large prime factors, where cv::dft is slow
+    const std::vector<cv::Size> sizes = {
+        {1280 / 3, 720 / 3},
+        {1280 / 7, 720 / 7},
+        {1366 / 2, 768 / 2},
+        {1366, 768},
+    };
+
+    std::cout << "Padding to optimal DFT size\n";
+    for(const auto& size : sizes){
+        auto img0 = createSyntheticImage(size.width, size.height);
+        auto img1 = getTransformed(img0, t_01);
+
+        for(bool pad : {false, true}){
+            FourierMellinWithReference fm(size.width, size.height, RegistrationOptions{.padToOptimalDftSize=pad});
+            fm.SetReference(img0);
+
+            Transform transform;
+            double seconds = measureSeconds(iterations, [&]{
+                transform = fm.GetRegisteredImageTransform(img1);
+            });
+            auto spectrumSize = getSpectrumSize(size.width, size.height, RegistrationOptions{.padToOptimalDftSize=pad});
+            std::cout << "  " << std::setw(4) << size.width << "x" << std::setw(4) << size.height
+                << " (spectrum " << std::setw(4) << spectrumSize.width << "x" << std::setw(4) << spectrumSize.height << "): "
+                << std::fixed << std::setprecision(3) << seconds / iterations * 1e3 << " ms, " << transform << "\n";
+        }
+    }
+}
+
+// Registration error against a known transform, averaged over `ts`
+template<typename Register>
+void printRegistrationError(const cv::Mat& img, const std::vector<Transform>& ts, Register&& registerImages){
+    double offsetError = 0.0, scaleError = 0.0, rotationError = 0.0;
+    for(const auto& t_01 : ts){
+        auto transform = registerImages(img, getTransformed(img, t_01));
+        offsetError += std::hypot(transform.GetOffsetX() - t_01.GetOffsetX(), transform.GetOffsetY() - t_01.GetOffsetY());
+        scaleError += std::abs(transform.GetScale() - t_01.GetScale());
+        rotationError += std::abs(transform.GetRotation() - t_01.GetRotation());
+    }
+    std::cout << "offset " << offsetError / ts.size() << " px, scale " << scaleError / ts.size()
+        << ", rotation " << rotationError / ts.size() << " deg";
+}
+
+void benchmarkFixedPointMaps(){
+    constexpr int iterations = 100;
+    const std::vector<Transform> ts = {
+        Transform(-20, 15, 0.8, -20, 1),
+        Transform(-30, 20, 0.95, -15, 1),
+        Transform(10, -5, 1.1, 30, 1),
+    };
+    const std::vector<cv::Size> sizes = {{320, 240}, {640, 480}, {1280, 720}};
+
+    std::cout << "Fixed-point log-polar maps\n";
+    for(const auto& size : sizes){
+        auto img = createSyntheticImage(size.width, size.height);
+        auto gray = convertToGrayscale(img);
+
+        for(bool fixedPoint : {false, true}){
+            RegistrationOptions options{.fixedPointLogPolarMap=fixedPoint};
+            auto spectrumSize = getSpectrumSize(size.width, size.height, options);
+            auto highPassFilter = getHighPassFilter(spectrumSize.height, spectrumSize.width);
+            auto apodizationWindow = getApodizationWindow(size.width, size.height, std::min(size.width, size.height));
+            auto logPolarMap = createLogPolarMap(spectrumSize.width, spectrumSize.height, fixedPoint);
+
+            ProcessingBuffers buffers;
+            getApodizedSpectrum(gray, apodizationWindow, spectrumSize, buffers);
+            getFilteredMagnitude(buffers.spectrum, highPassFilter, buffers.magnitude);
+            double seconds = measureSeconds(iterations, [&]{
+                remapLogPolar(buffers.magnitude, buffers.logPolar, logPolarMap);
+            });
+
+            FourierMellin fm(size.width, size.height, options);
+            std::cout << "  " << std::setw(4) << size.width << "x" << std::setw(4) << size.height
+                << (fixedPoint ? " fixed: " : " float: ")
+                << std::fixed << std::setprecision(3) << seconds / iterations * 1e3 << " ms remap, error ";
+            printRegistrationError(img, ts, [&](const cv::Mat& img0, const cv::Mat& img1){
+                return std::get<1>(fm.GetRegisteredImage(img0, img1));
+            });
+            std::cout << "\n";
+        }
+    }
+}
+
+void benchmarkPyramid(){
+    constexpr int iterations = 50;
+    const std::vector<Transform> ts = {
+        Transform(-20, 15, 0.8, -20, 1),
+        Transform(-30, 20, 0.95, -15, 1),
+        Transform(10, -5, 1.1, 30, 1),
+    };
+    const std::vector<cv::Size> sizes = {{640, 480}, {1280, 720}, {1920, 1080}};
+
+    std::cout << "Pyramid levels\n";
+    for(const auto& size : sizes){
+        auto img = createSyntheticImage(size.width, size.height);
+        auto img1 = getTransformed(img, ts[0]);
+
+        for(int levels : {0, 1, 2, 3}){
+            RegistrationOptions options{.pyramidLevels=levels};
+            FourierMellinWithReference fm(size.width, size.height, options);
+            fm.SetReference(img);
+            double seconds = measureSeconds(iterations, [&]{
+                fm.GetRegisteredImageTransform(img1);
+            });
+
+            std::cout << "  " << std::setw(4) << size.width << "x" << std::setw(4) << size.height
+                << " levels " << levels << ": "
+                << std::fixed << std::setprecision(3) << seconds / iterations * 1e3 << " ms, error ";
+            printRegistrationError(img, ts, [&](const cv::Mat& img0, const cv::Mat& img1){
+                fm.SetReference(img1);
+                return fm.GetRegisteredImageTransform(img0);
+            });
+            std::cout << "\n";
+        }
+    }
+}
+
+int main(){
+    benchmarkPadding();
+    benchmarkFixedPointMaps();
+    benchmarkPyramid();
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <benchmark/benchmark.h>
+
+// TODO: Fix project include structure in src/CMakeLists.txt
+#include "../src/fourier_mellin.hpp"
+#include "synthetic_image.hpp"
+
+const Transform t_01(-12, 7, 0.95, 8, 1);
+
+// 64x64 up to 4K
+void applySizes(benchmark::internal::Benchmark* benchmark){
+    for(auto[cols, rows] : {std::pair{64, 64}, {320, 240}, {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}}){
+        benchmark->Args({cols, rows});
+    }
+    benchmark->Unit(benchmark::kMillisecond);
+}
+
+// Everything the stages need, prepared once per size outside the timed loop
+struct StageFixture{
+    int cols;
+    int rows;
+    cv::Mat img;
+    cv::Mat gray;
+    std::shared_ptr<const RegistrationPlan> plan;
+    RegistrationBuffers buffers;
+    ReferenceSpectra reference;
+
+    explicit StageFixture(const benchmark::State& state):
+        cols(state.range(0)),
+        rows(state.range(1)),
+        img(createSyntheticImage(cols, rows)),
+        gray(convertToGrayscale(img)),
+        plan(createRegistrationPlan(cols, rows))
+    {
+        reference = getReferenceSpectra(getTransformed(img, t_01), *plan, buffers);
+        getApodizedSpectrum(img, plan->apodizationWindow, plan->spectrumSize, buffers.processing);
+        getFilteredMagnitude(buffers.processing.spectrum, plan->highPassFilter, buffers.processing.magnitude);
+        remapLogPolar(buffers.processing.magnitude, buffers.processing.logPolar, plan->logPolarMap);
+    }
+};
+
+void BM_Grayscale(benchmark::State& state){
+    StageFixture f(state);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(convertToGrayscale(f.img, f.buffers.processing.grayBuffer).data);
+    }
+}
+
+void BM_Apodization(benchmark::State& state){
+    StageFixture f(state);
+    for(auto _ : state){
+        // Converts the color image to grayscale in the same pass
+        getApodizedImage(f.img, f.plan->apodizationWindow, f.plan->spectrumSize, f.buffers.processing.apodized);
+    }
+}
+
+void BM_FFT(benchmark::State& state){
+    StageFixture f(state);
+    cv::Mat apodized;
+    getApodizedImage(f.img, f.plan->apodizationWindow, f.plan->spectrumSize, apodized);
+    for(auto _ : state){
+        fft(apodized, f.buffers.processing.spectrum);
+    }
+}
+
+void BM_ShiftFilter(benchmark::State& state){
+    StageFixture f(state);
+    for(auto _ : state){
+        getFilteredMagnitude(f.buffers.processing.spectrum, f.plan->highPassFilter, f.buffers.processing.magnitude);
+    }
+}
+
+void BM_LogPolarRemap(benchmark::State& state){
+    StageFixture f(state);
+    for(auto _ : state){
+        remapLogPolar(f.buffers.processing.magnitude, f.buffers.processing.logPolar, f.plan->logPolarMap);
+    }
+}
+
+void BM_LogPolarCorrelation(benchmark::State& state){
+    StageFixture f(state);
+    for(auto _ : state){
+        getCorrelationSpectrum(f.buffers.processing.logPolar, f.buffers.logPolarSpectrum, f.buffers.logPolarCorrelation);
+        benchmark::DoNotOptimize(phaseCorrelateSpectrums(f.reference.logPolarSpectrum, f.buffers.logPolarSpectrum, f.buffers.logPolarCorrelation));
+    }
+}
+
+void BM_TranslationCorrelation(benchmark::State& state){
+    StageFixture f(state);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(registerTranslation(f.gray, t_01.GetRotation(), t_01.GetScale(), f.reference.spectrum, f.buffers));
+    }
+}
+
+void BM_Warp(benchmark::State& state){
+    StageFixture f(state);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(getTransformed(f.img, t_01).data);
+    }
+}
+
+void BM_HighPassFilter(benchmark::State& state){
+    int cols = state.range(0);
+    int rows = state.range(1);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(getHighPassFilter(rows, cols).data);
+    }
+}
+
+// Cold start of a registration: the plan built without the cache
+void BM_PlanCreation(benchmark::State& state){
+    int cols = state.range(0);
+    int rows = state.range(1);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(createRegistrationPlan(cols, rows));
+    }
+}
+
+// A full registration with the stage timers recording (third argument 1) or
+// not. Without FOURIER_MELLIN_STATS both compile to the same code, so build
+// with -DFOURIER_MELLIN_STATS=ON to see the cost of recording.
+void BM_RegistrationStats(benchmark::State& state){
+    StageFixture f(state);
+    [[maybe_unused]] RegistrationStats stats;
+    for(auto _ : state){
+        if(state.range(2)){
+            REGISTRATION_STATS_SCOPE(stats);
+            benchmark::DoNotOptimize(registerGrayImage(f.gray, f.reference, *f.plan, f.buffers));
+        }
+        else{
+            benchmark::DoNotOptimize(registerGrayImage(f.gray, f.reference, *f.plan, f.buffers));
+        }
+    }
+}
+
+void applyStatsSizes(benchmark::internal::Benchmark* benchmark){
+    for(auto[cols, rows] : {std::pair{64, 64}, {640, 480}, {1920, 1080}}){
+        benchmark->Args({cols, rows, 0});
+        benchmark->Args({cols, rows, 1});
+    }
+    benchmark->Unit(benchmark::kMillisecond);
+}
+
+void BM_FourierMellin(benchmark::State& state){
+    int cols = state.range(0);
+    int rows = state.range(1);
+    auto img0 = createSyntheticImage(cols, rows);
+    auto img1 = getTransformed(img0, t_01);
+    FourierMellin fm(cols, rows);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(fm.GetRegisteredImage(img0, img1));
+    }
+}
+
+void BM_FourierMellinContinuous(benchmark::State& state){
+    int cols = state.range(0);
+    int rows = state.range(1);
+    // Alternating frames, so every call registers against a different previous frame
+    auto img0 = createSyntheticImage(cols, rows);
+    auto img1 = getTransformed(img0, t_01);
+    FourierMellinContinuous fm(cols, rows);
+    fm.GetRegisteredImage(img0);
+    bool odd = true;
+    for(auto _ : state){
+        benchmark::DoNotOptimize(fm.GetRegisteredImage((odd = !odd) ? img0 : img1));
+    }
+}
+
+void BM_FourierMellinWithReference(benchmark::State& state){
+    int cols = state.range(0);
+    int rows = state.range(1);
+    auto img0 = createSyntheticImage(cols, rows);
+    auto img1 = getTransformed(img0, t_01);
+    FourierMellinWithReference fm(cols, rows);
+    fm.SetReference(img0);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(fm.GetRegisteredImageTransform(img1));
+    }
+}
+
+BENCHMARK(BM_Grayscale)->Apply(applySizes);
+BENCHMARK(BM_Apodization)->Apply(applySizes);
+BENCHMARK(BM_FFT)->Apply(applySizes);
+BENCHMARK(BM_ShiftFilter)->Apply(applySizes);
+BENCHMARK(BM_LogPolarRemap)->Apply(applySizes);
+BENCHMARK(BM_LogPolarCorrelation)->Apply(applySizes);
+BENCHMARK(BM_TranslationCorrelation)->Apply(applySizes);
+BENCHMARK(BM_Warp)->Apply(applySizes);
+BENCHMARK(BM_HighPassFilter)->Apply(applySizes);
+BENCHMARK(BM_PlanCreation)->Apply(applySizes);
+BENCHMARK(BM_RegistrationStats)->Apply(applyStatsSizes);
+BENCHMARK(BM_FourierMellin)->Apply(applySizes);
+BENCHMARK(BM_FourierMellinContinuous)->Apply(applySizes);
+BENCHMARK(BM_FourierMellinWithReference)->Apply(applySizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// TODO: Fix project include structure in src/CMakeLists.txt
+#include "../src/transform.hpp"
+
+// Every heap allocation of the process, to show that the loops below make none
+static std::atomic<size_t> allocationCount = 0;
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// Allocations per iteration of the timed loop
+class AllocationCounter{
+public:
+    explicit AllocationCounter(benchmark::State& state): state_(state), start_(allocationCount.load()) {}
+    ~AllocationCounter() {
+        state_.counters["allocations"] = benchmark::Counter(allocationCount.load() - start_, benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State& state_;
+    size_t start_;
+};
+
+void BM_TransformCompose(benchmark::State& state){
+    Transform step(1.5, -0.5, 1.001, 0.3, 0.9);
+    Transform total;
+    AllocationCounter counter(state);
+    for(auto _ : state){
+        total = step * total;
+        benchmark::DoNotOptimize(total);
+    }
+}
+
+void BM_TransformInverse(benchmark::State& state){
+    Transform t(12.0, -7.0, 0.95, 8.0, 1.0);
+    AllocationCounter counter(state);
+    for(auto _ : state){
+        benchmark::DoNotOptimize(t = t.GetInverse());
+    }
+}
+
+// The previous implementation, through heap allocated matrices
+void BM_TransformComposeMatrix(benchmark::State& state){
+    Transform step(1.5, -0.5, 1.001, 0.3, 0.9);
+    Transform total;
+    AllocationCounter counter(state);
+    for(auto _ : state){
+        total = Transform(cv::Mat(step.GetMatrix() * total.GetMatrix()), 0.9);
+        benchmark::DoNotOptimize(total);
+    }
+}
+
+BENCHMARK(BM_TransformCompose);
+BENCHMARK(BM_TransformInverse);
+BENCHMARK(BM_TransformComposeMatrix);
+
+BENCHMARK_MAIN();
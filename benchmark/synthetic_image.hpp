@@ -0,0 +1,29 @@
+#ifndef __SYNTHETIC_IMAGE_H__
+#define __SYNTHETIC_IMAGE_H__
+
+#include <opencv2/opencv.hpp>
+
+// Deterministic test image with smooth noise and hard edges, so benchmarks
+// run anywhere without image files
+inline cv::Mat createSyntheticImage(int cols, int rows){
+    cv::Mat img(rows, cols, CV_32FC3);
+    cv::setRNGSeed(1234);
+    cv::randu(img, cv::Scalar::all(0.0), cv::Scalar::all(255.0));
+    cv::GaussianBlur(img, img, cv::Size(0, 0), 1.0 + std::max(cols, rows) / 200.0);
+
+    // Some hard edges so that the spectrum is not only low frequencies
+    for(int i=0; i<16; i++){
+        cv::Point center((37 * i) % cols, (61 * i) % rows);
+        int radius = std::max(2, std::min(cols, rows) / (4 + i));
+        cv::Scalar color((17 * i) % 255, (91 * i) % 255, (143 * i) % 255);
+        if(i % 2 == 0){
+            cv::circle(img, center, radius, color, -1);
+        }
+        else{
+            cv::rectangle(img, cv::Rect(center.x, center.y, radius, radius), color, -1);
+        }
+    }
+    return img;
+}
+
+#endif // __SYNTHETIC_IMAGE_H__
@@ -21,7 +21,7 @@ def stabilize_video(input_path, output_path):
             break
         img, t = fm.register_image(frame, firstFrame)
         # print(img.shape, t)
-        out.write(img.astype(np.uint8))
+        out.write(img)
     out.release()
         
 if __name__ == '__main__':
@@ -0,0 +1,11 @@
+import fourier_mellin
+
+if __name__ == '__main__':
+    input_path = "resources/shaky_drone.mp4"
+    output_path = "output/stabilized_shaky_drone.mp4"
+
+    # Decoding, registration and encoding all run in C++
+    options = fourier_mellin.StabilizationOptions()
+    options.edge_crop = 0.1
+    transforms = fourier_mellin.stabilize_video(input_path, output_path, options)
+    print(f"Stabilized {len(transforms)} frames")
@@ -0,0 +1,63 @@
+#ifndef __BOUNDED_QUEUE_H__
+#define __BOUNDED_QUEUE_H__
+
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Blocking FIFO queue between pipeline stages. A full queue blocks the
+// producer, which is how backpressure propagates to the caller.
+template<typename T>
+class BoundedQueue{
+public:
+    explicit BoundedQueue(size_t capacity):
+        capacity_(std::max<size_t>(capacity, 1)),
+        closed_(false)
+    {
+    }
+
+    // Blocks while the queue is full. Returns false if the queue was closed.
+    bool Push(T item) {
+        std::unique_lock lock(mutex_);
+        notFull_.wait(lock, [this]{ return closed_ || items_.size() < capacity_; });
+        if(closed_){
+            return false;
+        }
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty. Empty once the queue is closed and drained.
+    std::optional<T> Pop() {
+        std::unique_lock lock(mutex_);
+        notEmpty_.wait(lock, [this]{ return closed_ || !items_.empty(); });
+        if(items_.empty()){
+            return std::nullopt;
+        }
+        T item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return item;
+    }
+
+    // Wakes all waiting threads. Items already queued can still be popped.
+    void Close() {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    bool closed_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+};
+
+#endif // __BOUNDED_QUEUE_H__
@@ -1,12 +1,18 @@
 #include "fourier_mellin.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
 
-FourierMellin::FourierMellin(int cols, int rows):
-    cols_(cols), rows_(rows),
-    highPassFilter_(getHighPassFilter(rows_, cols_)),
-    apodizationWindow_(getApodizationWindow(cols_, rows_, std::min(rows, cols))),
-    logPolarMap_(createLogPolarMap(cols_, rows_))
+FourierMellin::FourierMellin(int cols, int rows, const RegistrationOptions& options):
+    FourierMellin(getRegistrationPlan(cols, rows, options))
+{
+}
+
+FourierMellin::FourierMellin(std::shared_ptr<const RegistrationPlan> plan):
+    plan_(std::move(plan))
 {
 }
 
@@ -14,128 +20,359 @@ FourierMellin::~FourierMellin() {
 }
 
 cv::Mat FourierMellin::GetProcessImage(const cv::Mat &img) const {
-    return getProcessedImage(img, highPassFilter_, apodizationWindow_, logPolarMap_);
+    REGISTRATION_STATS_SCOPE(stats_);
+    return getProcessedImage(img, plan_->highPassFilter, plan_->apodizationWindow, plan_->logPolarMap);
 }
 
-cv::Mat convertToGrayscale(const cv::Mat& img){
-    // TODO: Don't return another mat, modify 'img' instead
-    if(img.channels() == 1){
-        return img;
-    }
-    else if(img.channels() == 3){
-        cv::Mat gray;
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
-        return gray;
+std::tuple<cv::Mat, Transform> FourierMellin::GetRegisteredImage(const cv::Mat &img0, const cv::Mat &img1) const {
+    REGISTRATION_STATS_SCOPE(stats_);
+    auto& buffers = getThreadRegistrationBuffers();
+    Transform transform;
+    if(needsPlanRegistration(*plan_)){
+        transform = registerGrayImage(img0, getReferenceSpectra(img1, *plan_, buffers), *plan_, buffers);
     }
     else{
-        throw std::runtime_error("Cannot convert to grayscale with " + std::to_string(img.channels()) + " channels.");
-        return cv::Mat();
+        const cv::Mat& gray0 = convertToGrayscale(img0, buffers.processing.grayBuffer);
+        const cv::Mat& gray1 = convertToGrayscale(img1, buffers.referenceGray);
+        auto logPolar0 = GetProcessImage(gray0);
+        auto logPolar1 = GetProcessImage(gray1);
+        transform = registerGrayImage(gray0, gray1, logPolar0, logPolar1, plan_->logPolarMap);
     }
-}
-
-std::tuple<cv::Mat, Transform> FourierMellin::GetRegisteredImage(const cv::Mat &img0, const cv::Mat &img1) const {
-    cv::Mat gray0 = convertToGrayscale(img0);
-    cv::Mat gray1 = convertToGrayscale(img1);
-
-    auto logPolar0 = GetProcessImage(gray0);
-    auto logPolar1 = GetProcessImage(gray1);
-
-    auto transform = registerGrayImage(gray0, gray1, logPolar0, logPolar1, logPolarMap_);
     auto transformed = getTransformed(img0, transform);
 
     return std::make_tuple(transformed, transform);
 }
 
-FourierMellinContinuous::FourierMellinContinuous(int cols, int rows, double edgeCrop, double pullToCenterRatio):
-    cols_(cols), rows_(rows),
+std::vector<StageStats> FourierMellin::GetStats() const {
+    return stats_.Get();
+}
+
+void FourierMellin::ResetStats() {
+    stats_.Reset();
+}
+
+FourierMellinContinuous::FourierMellinContinuous(int cols, int rows, double edgeCrop, double pullToCenterRatio, const RegistrationOptions& options, const KeyframeOptions& keyframes):
+    plan_(getRegistrationPlan(cols, rows, options)),
     edgeCrop_(edgeCrop),
     pullToCenterRatio_(pullToCenterRatio),
-    highPassFilter_(getHighPassFilter(rows_, cols_)),
-    apodizationWindow_(getApodizationWindow(cols_, rows_, std::min(rows, cols))),
-    logPolarMap_(createLogPolarMap(cols_, rows_)),
-    isFirst_(true)
+    keyframes_(keyframes),
+    isFirst_(true),
+    grayBufferIndex_(0),
+    isPrevKeyframe_(false),
+    keyframeCount_(0)
 {
+    CV_Assert(pullToCenterRatio >= 0.0 && pullToCenterRatio <= 1.0);
 }
 
 FourierMellinContinuous::~FourierMellinContinuous() {
 }
 
 std::tuple<cv::Mat, Transform> FourierMellinContinuous::GetRegisteredImage(const cv::Mat &img) {
-    cv::Mat gray = convertToGrayscale(img);
-    auto logPolar = getProcessedImage(gray, highPassFilter_, apodizationWindow_, logPolarMap_);
+    auto totalTransform = Accumulate(Preprocess(img));
+    if(!totalTransform){
+        return {cv::Mat(), Transform{}};
+    }
+    return {Warp(img, *totalTransform), *totalTransform};
+}
+
+size_t FourierMellinContinuous::GetKeyframeCount() const {
+    return keyframeCount_;
+}
+
+std::vector<StageStats> FourierMellinContinuous::GetStats() const {
+    return stats_.Get();
+}
+
+void FourierMellinContinuous::ResetStats() {
+    stats_.Reset();
+}
+
+FourierMellinContinuous::Frame FourierMellinContinuous::Preprocess(const cv::Mat &img) const {
+    REGISTRATION_STATS_SCOPE(stats_);
+    if(keyframes_.enabled){
+        // Only keyframes need their spectrums, they are computed when taken
+        return Frame{img};
+    }
+    if(needsPlanRegistration(*plan_)){
+        // The next frame is registered against the spectrums of this one
+        return Frame{img, cv::Mat(), getReferenceSpectra(img, *plan_, getThreadRegistrationBuffers())};
+    }
+    // The apodization converts to grayscale on the fly, the gray image kept
+    // for the next frame is converted by `Accumulate` into a reused buffer
+    auto logPolar = getProcessedImage(img, plan_->highPassFilter, plan_->apodizationWindow, plan_->logPolarMap);
+    return Frame{img, logPolar};
+}
 
+std::optional<Transform> FourierMellinContinuous::Accumulate(const Frame& frame) {
+    REGISTRATION_STATS_SCOPE(stats_);
+    // Only keyframes and the plain log-polar correlation need the previous frame itself
+    cv::Mat gray;
+    if(keyframes_.enabled || !needsPlanRegistration(*plan_)){
+        gray = GetGray(frame.img);
+    }
     if(std::exchange(isFirst_, false)){
         prevGray_ = gray;
-        prevLogPolar_ = logPolar;
+        prevLogPolar_ = frame.logPolar;
+        prevSpectra_ = frame.spectra;
         totalTransform_ = Transform{};
-        return {cv::Mat(), Transform{}};
+        if(keyframes_.enabled){
+            SetKeyframe(gray);
+        }
+        return std::nullopt;
+    }
+
+    Transform transform;
+    if(keyframes_.enabled){
+        transform = RegisterWithKeyframe(gray);
+    }
+    else if(needsPlanRegistration(*plan_)){
+        transform = registerGrayImage(frame.img, prevSpectra_, *plan_, getThreadRegistrationBuffers());
     }
     else{
-        auto transform = registerGrayImage(gray, prevGray_, logPolar, prevLogPolar_, logPolarMap_);
+        transform = registerGrayImage(gray, prevGray_, frame.logPolar, prevLogPolar_, plan_->logPolarMap);
+    }
 
-        prevGray_ = gray;
-        prevLogPolar_ = logPolar;
-        if(totalTransform_.GetScale() < 1e-5){
-            totalTransform_ = transform;
-        }
-        else{
-            totalTransform_ = transform * totalTransform_;
+    prevGray_ = gray;
+    prevLogPolar_ = frame.logPolar;
+    prevSpectra_ = frame.spectra;
+    if(totalTransform_.GetScale() < 1e-5){
+        totalTransform_ = transform;
+    }
+    else{
+        totalTransform_ = getPulledToCenter(transform * totalTransform_, pullToCenterRatio_);
+    }
+    return totalTransform_;
+}
 
-            // TODO: Pull to center with new transforms
-            // transformSum_.xOffset += (- transformSum_.xOffset) * pullToCenterRatio_;
-            // transformSum_.yOffset += (- transformSum_.yOffset) * pullToCenterRatio_;
-        }
-        auto transformed = getTransformed(img, totalTransform_);
-        if(edgeCrop_ != 0.0){
-            auto cropped = getCropped(transformed, edgeCrop_ * cols_, edgeCrop_ * rows_, (1.0 - edgeCrop_) * cols_, (1.0 - edgeCrop_) * rows_);
-            cv::resize(cropped, cropped, cv::Size(cols_, rows_), cv::INTER_LINEAR);
-            return {cropped, totalTransform_};
-        }
-        else{
-            return {transformed, totalTransform_};
-        }
+Transform FourierMellinContinuous::RegisterWithKeyframe(const cv::Mat& gray) {
+    auto& buffers = getThreadRegistrationBuffers();
+    auto relative = registerGrayImage(gray, keyframeSpectra_, *plan_, buffers);
+    if(!IsNearKeyframe(relative) && !isPrevKeyframe_){
+        // The previous frame is still close to this one, register against it instead
+        SetKeyframe(prevGray_);
+        relative = registerGrayImage(gray, keyframeSpectra_, *plan_, buffers);
     }
+
+    // Relative transforms of consecutive frames share the keyframe, so without
+    // a new keyframe their errors do not add up over the frames
+    auto transform = relative * keyframeRelative_.GetInverse();
+    if(IsNearKeyframe(relative)){
+        keyframeRelative_ = relative;
+        isPrevKeyframe_ = false;
+    }
+    else{
+        SetKeyframe(gray);
+    }
+    return transform;
+}
+
+bool FourierMellinContinuous::IsNearKeyframe(const Transform& relative) const {
+    double offset = std::hypot(relative.GetOffsetX(), relative.GetOffsetY()) / std::max(plan_->cols, plan_->rows);
+    return relative.GetResponse() >= keyframes_.minResponse
+        && offset <= keyframes_.maxOffset
+        && std::abs(std::remainder(relative.GetRotation(), 360.0)) <= keyframes_.maxRotation
+        && std::abs(std::log(relative.GetScale())) <= std::log1p(keyframes_.maxScaleChange);
+}
+
+void FourierMellinContinuous::SetKeyframe(const cv::Mat& gray) {
+    keyframeSpectra_ = getReferenceSpectra(gray, *plan_, getThreadRegistrationBuffers());
+    keyframeRelative_ = Transform{};
+    isPrevKeyframe_ = true;
+    keyframeCount_++;
 }
 
-FourierMellinWithReference::FourierMellinWithReference(int cols, int rows):
-    cols_(cols), rows_(rows),
-    highPassFilter_(getHighPassFilter(rows_, cols_)),
-    apodizationWindow_(getApodizationWindow(cols_, rows_, std::min(rows, cols))),
-    logPolarMap_(createLogPolarMap(cols_, rows_))
+cv::Mat FourierMellinContinuous::GetGray(const cv::Mat& img) {
+    // Converting into the other buffer leaves `prevGray_` intact without allocating
+    const cv::Mat& gray = convertToGrayscale(img, grayBuffers_[grayBufferIndex_]);
+    if(&gray != &img){
+        grayBufferIndex_ ^= 1;
+    }
+    return gray;
+}
+
+cv::Mat FourierMellinContinuous::Warp(const cv::Mat &img, const Transform& totalTransform) const {
+    REGISTRATION_STATS_SCOPE(stats_);
+    return getEdgeCropped(getTransformed(img, totalTransform), edgeCrop_);
+}
+
+FourierMellinWithReference::FourierMellinWithReference(int cols, int rows, const RegistrationOptions& options):
+    FourierMellinWithReference(getRegistrationPlan(cols, rows, options))
+{
+}
+
+FourierMellinWithReference::FourierMellinWithReference(std::shared_ptr<const RegistrationPlan> plan):
+    plan_(std::move(plan)),
+    references_(std::make_shared<const References>()),
+    threadCount_(0)
 {
 }
 
 FourierMellinWithReference::~FourierMellinWithReference() {
 }
 
+std::shared_ptr<const FourierMellinWithReference::References> FourierMellinWithReference::GetReferences() const {
+    std::lock_guard lock(referencesMutex_);
+    return references_;
+}
+
 void FourierMellinWithReference::SetReference(const cv::Mat &img, int designation) {
-    references_[designation] = convertToGrayscale(img);
-    referenceLogPolars_[designation] = getProcessedImage(references_[designation], highPassFilter_, apodizationWindow_, logPolarMap_);
-    currentDesignation_ = designation;
+    REGISTRATION_STATS_SCOPE(stats_);
+    auto spectra = std::make_shared<const ReferenceSpectra>(getReferenceSpectra(img, *plan_, getThreadRegistrationBuffers()));
+    auto descriptor = getLogPolarDescriptor(spectra->logPolarSpectrum);
+
+    // Copying the references only copies pointers to the spectrums
+    std::lock_guard lock(referencesMutex_);
+    auto references = std::make_shared<References>(*references_);
+    if(auto index = references->Find(designation)){
+        references->spectra[*index] = std::move(spectra);
+        references->descriptors[*index] = descriptor;
+    }
+    else{
+        references->designations.push_back(designation);
+        references->spectra.push_back(std::move(spectra));
+        references->descriptors.push_back(descriptor);
+    }
+    references->currentDesignation = designation;
+    references_ = std::move(references);
 }
 
 void FourierMellinWithReference::SetReferenceWithDesignation(int designation){
-    if(!references_.contains(designation)){
+    std::lock_guard lock(referencesMutex_);
+    if(!references_->Find(designation)){
         std::cerr << "References do not contain given designation: " << designation << "\n";
         return;
     }
-    currentDesignation_ = designation;
+    auto references = std::make_shared<References>(*references_);
+    references->currentDesignation = designation;
+    references_ = std::move(references);
 }
 
-std::tuple<cv::Mat, Transform> FourierMellinWithReference::GetRegisteredImage(const cv::Mat &img) const {
-    cv::Mat gray = convertToGrayscale(img);
-    auto logPolar = getProcessedImage(gray, highPassFilter_, apodizationWindow_, logPolarMap_);
-
-    auto transform = registerGrayImage(gray, references_.at(currentDesignation_), logPolar, referenceLogPolars_.at(currentDesignation_), logPolarMap_);
+std::tuple<cv::Mat, Transform> FourierMellinWithReference::GetRegisteredImage(const cv::Mat &img, RegistrationMode mode) const {
+    auto transform = GetRegisteredImageTransform(img, mode);
+    REGISTRATION_STATS_SCOPE(stats_);
     auto transformed = getTransformed(img, transform);
 
     return {transformed, transform};
 }
 
-Transform FourierMellinWithReference::GetRegisteredImageTransform(const cv::Mat &img) const {
-    cv::Mat gray = convertToGrayscale(img);
-    auto logPolar = getProcessedImage(gray, highPassFilter_, apodizationWindow_, logPolarMap_);
+Transform FourierMellinWithReference::GetRegisteredImageTransform(const cv::Mat &img, RegistrationMode mode) const {
+    // Holding the snapshot keeps the reference alive even if it is replaced meanwhile
+    auto references = GetReferences();
+    return RegisterWithReference(img, references->At(references->currentDesignation), mode);
+}
 
-    auto transform = registerGrayImage(gray, references_.at(currentDesignation_), logPolar, referenceLogPolars_.at(currentDesignation_), logPolarMap_);
-    return transform;
+std::vector<Transform> FourierMellinWithReference::GetRegistrationCandidates(const cv::Mat &img) const {
+    if(plan_->rotationScaleCandidates == 0){
+        throw std::runtime_error("Rotation and scale candidates are not enabled in the registration options.");
+    }
+    auto references = GetReferences();
+    const auto& reference = references->At(references->currentDesignation);
+
+    REGISTRATION_STATS_SCOPE(stats_);
+    return registerGrayImageCandidates(img, reference, *plan_, getThreadRegistrationBuffers());
+}
+
+std::vector<std::tuple<int, Transform>> FourierMellinWithReference::SearchReferences(const cv::Mat &img, size_t count, RegistrationMode mode) const {
+    auto references = GetReferences();
+    const auto& descriptors = references->descriptors;
+    count = std::min(count, descriptors.size());
+    if(count == 0){
+        return {};
+    }
+
+    LogPolarDescriptor descriptor;
+    {
+        REGISTRATION_STATS_SCOPE(stats_);
+        descriptor = getLogPolarDescriptor(getLogPolarSpectrum(img, *plan_, getThreadRegistrationBuffers()));
+    }
+
+    std::vector<float> similarities(descriptors.size());
+    for(size_t i=0; i<descriptors.size(); i++){
+        similarities[i] = std::inner_product(descriptor.begin(), descriptor.end(), descriptors[i].begin(), 0.0f);
+    }
+    std::vector<size_t> order(descriptors.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](size_t a, size_t b){
+        return similarities[a] > similarities[b];
+    });
+
+    std::vector<std::tuple<int, Transform>> results(count);
+    GetThreadPool()->ParallelFor(count, [&](size_t i){
+        results[i] = std::make_tuple(references->designations[order[i]], RegisterWithReference(img, *references->spectra[order[i]], mode));
+    });
+    std::stable_sort(results.begin(), results.end(), [](const auto& a, const auto& b){
+        return std::get<1>(a).GetResponse() > std::get<1>(b).GetResponse();
+    });
+    return results;
+}
+
+std::vector<Transform> FourierMellinWithReference::RegisterBatch(std::span<const cv::Mat> imgs, RegistrationMode mode) const {
+    auto references = GetReferences();
+    const auto& reference = references->At(references->currentDesignation);
+
+    std::vector<Transform> transforms(imgs.size());
+    GetThreadPool()->ParallelFor(imgs.size(), [&](size_t i){
+        transforms[i] = RegisterWithReference(imgs[i], reference, mode);
+    });
+    return transforms;
+}
+
+std::vector<std::tuple<cv::Mat, Transform>> FourierMellinWithReference::GetRegisteredImageBatch(std::span<const cv::Mat> imgs, RegistrationMode mode) const {
+    auto references = GetReferences();
+    const auto& reference = references->At(references->currentDesignation);
+
+    std::vector<std::tuple<cv::Mat, Transform>> results(imgs.size());
+    GetThreadPool()->ParallelFor(imgs.size(), [&](size_t i){
+        auto transform = RegisterWithReference(imgs[i], reference, mode);
+        REGISTRATION_STATS_SCOPE(stats_);
+        results[i] = std::make_tuple(getTransformed(imgs[i], transform), transform);
+    });
+    return results;
+}
+
+void FourierMellinWithReference::SetThreadCount(unsigned threadCount) {
+    std::lock_guard lock(threadPoolMutex_);
+    if(threadCount != threadCount_){
+        threadCount_ = threadCount;
+        // Batches in progress keep their own reference to the old pool
+        threadPool_.reset();
+    }
+}
+
+std::vector<StageStats> FourierMellinWithReference::GetStats() const {
+    return stats_.Get();
+}
+
+void FourierMellinWithReference::ResetStats() {
+    stats_.Reset();
+}
+
+std::optional<size_t> FourierMellinWithReference::References::Find(int designation) const {
+    auto it = std::find(designations.begin(), designations.end(), designation);
+    if(it == designations.end()){
+        return std::nullopt;
+    }
+    return it - designations.begin();
+}
+
+const ReferenceSpectra& FourierMellinWithReference::References::At(int designation) const {
+    auto index = Find(designation);
+    if(!index){
+        throw std::out_of_range("References do not contain designation " + std::to_string(designation) + ".");
+    }
+    return *spectra[*index];
+}
+
+std::shared_ptr<ThreadPool> FourierMellinWithReference::GetThreadPool() const {
+    std::lock_guard lock(threadPoolMutex_);
+    if(!threadPool_){
+        threadPool_ = std::make_shared<ThreadPool>(threadCount_);
+    }
+    return threadPool_;
+}
+
+Transform FourierMellinWithReference::RegisterWithReference(const cv::Mat &img, const ReferenceSpectra& reference, RegistrationMode mode) const {
+    // Batches call this on the threads of the pool
+    REGISTRATION_STATS_SCOPE(stats_);
+    return registerGrayImage(img, reference, *plan_, getThreadRegistrationBuffers(), mode);
 }
@@ -2,67 +2,190 @@
 #define __FOURIER_MELLIN_H__
 
 #include <iostream>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
 
 #include "utilities.hpp"
 #include "transform.hpp"
+#include "registration_plan.hpp"
+#include "registration_plan_cache.hpp"
+#include "registration_stats.hpp"
+#include "thread_pool.hpp"
 
+// Stateless pairwise registration, safe to call from several threads at once.
 class FourierMellin{
 public:
-    FourierMellin(int cols, int rows);
+    FourierMellin(int cols, int rows, const RegistrationOptions& options = {});
+    FourierMellin(std::shared_ptr<const RegistrationPlan> plan);
     ~FourierMellin();
 
     cv::Mat GetProcessImage(const cv::Mat &img) const;
     std::tuple<cv::Mat, Transform> GetRegisteredImage(const cv::Mat &img0, const cv::Mat &img1) const;
 
+    std::vector<StageStats> GetStats() const;
+    void ResetStats();
+
 private:
-    int cols_, rows_;
-    cv::Mat highPassFilter_;
-    cv::Mat apodizationWindow_;
-    LogPolarMap logPolarMap_;
+    std::shared_ptr<const RegistrationPlan> plan_;
+    [[no_unique_address]] mutable RegistrationStats stats_;
+};
+
+// Registration of FourierMellinContinuous against a keyframe instead of the
+// previous frame. The keyframe is kept while the registration against it stays
+// reliable and the motion from it is within the bounds, so a static camera
+// registers every frame against one cached spectrum and the total transform is
+// not composed from many small errors.
+struct KeyframeOptions{
+    bool enabled = false;
+    // A new keyframe is taken when the response drops below this
+    double minResponse = 0.2;
+    // or when the offset, relative to the larger image side,
+    double maxOffset = 0.1;
+    // the rotation in degrees
+    double maxRotation = 10.0;
+    // or the relative change of scale exceeds these
+    double maxScaleChange = 0.1;
 };
 
+// Registers each image against the previous one, or against the last keyframe
+// with `keyframes.enabled`. Keeps state between calls, so
+// an instance must only be used by one thread at a time. The accumulated
+// transform is pulled towards the identity by `pullToCenterRatio` on every
+// frame, so slow camera motion is followed and the output stays framed, while
+// shakes faster than about 1 / pullToCenterRatio frames are removed. 0 keeps the
+// full accumulated transform.
 class FourierMellinContinuous{
 public:
-    FourierMellinContinuous(int cols, int rows, double edgeCrop = 0.1, double pullToCenterRatio = 0.07);
+    FourierMellinContinuous(int cols, int rows, double edgeCrop = 0.1, double pullToCenterRatio = 0.07, const RegistrationOptions& options = {}, const KeyframeOptions& keyframes = {});
     ~FourierMellinContinuous();
 
     std::tuple<cv::Mat, Transform> GetRegisteredImage(const cv::Mat &img);
 
+    // Keyframes taken so far including the first frame, 0 without keyframes
+    size_t GetKeyframeCount() const;
+
+    std::vector<StageStats> GetStats() const;
+    void ResetStats();
+
 private:
-    int cols_, rows_;
+    friend class FourierMellinContinuousPipelined;
+
+    struct Frame{
+        cv::Mat img;
+        cv::Mat logPolar;
+        // Instead of `logPolar` with pyramid levels
+        ReferenceSpectra spectra;
+    };
+
+    // The stages of `GetRegisteredImage`. Only `Accumulate` touches the state,
+    // so the others may run concurrently with it on other frames.
+    Frame Preprocess(const cv::Mat &img) const;
+    // Total transform of `frame`, or an empty optional for the first frame
+    std::optional<Transform> Accumulate(const Frame& frame);
+    cv::Mat Warp(const cv::Mat &img, const Transform& totalTransform) const;
+
+    // Transform of the frame of `gray` against the previous frame, taking a new keyframe if needed
+    Transform RegisterWithKeyframe(const cv::Mat& gray);
+    bool IsNearKeyframe(const Transform& relative) const;
+    void SetKeyframe(const cv::Mat& gray);
+    // Grayscale image of `img`, converted into the buffer not holding `prevGray_`
+    cv::Mat GetGray(const cv::Mat& img);
+
+    std::shared_ptr<const RegistrationPlan> plan_;
     double edgeCrop_;
     double pullToCenterRatio_;
-    cv::Mat highPassFilter_;
-    cv::Mat apodizationWindow_;
-    LogPolarMap logPolarMap_;
+    KeyframeOptions keyframes_;
 
     bool isFirst_;
     cv::Mat prevGray_;
+    cv::Mat grayBuffers_[2];
+    size_t grayBufferIndex_;
     cv::Mat prevLogPolar_;
+    ReferenceSpectra prevSpectra_;
     Transform totalTransform_;
+
+    ReferenceSpectra keyframeSpectra_;
+    // Previous frame against the keyframe
+    Transform keyframeRelative_;
+    bool isPrevKeyframe_;
+    size_t keyframeCount_;
+
+    // Stages may run on several threads in the pipelined variant
+    [[no_unique_address]] mutable RegistrationStats stats_;
 };
 
+// Registration against stored references. All methods may be called
+// concurrently: registrations work on an immutable snapshot of the references
+// and per-thread buffers, and `SetReference` publishes a new snapshot without
+// waiting for registrations in progress. Batches are spread over a thread pool
+// owned by the instance, which concurrent batches share.
 class FourierMellinWithReference{
 public:
-    FourierMellinWithReference(int cols, int rows);
+    FourierMellinWithReference(int cols, int rows, const RegistrationOptions& options = {});
+    FourierMellinWithReference(std::shared_ptr<const RegistrationPlan> plan);
     ~FourierMellinWithReference();
 
     void SetReference(const cv::Mat &img, int designation = -1);
     void SetReferenceWithDesignation(int designation);
-    std::tuple<cv::Mat, Transform> GetRegisteredImage(const cv::Mat &img) const;
-    Transform GetRegisteredImageTransform(const cv::Mat &img) const;
+    std::tuple<cv::Mat, Transform> GetRegisteredImage(const cv::Mat &img, RegistrationMode mode = RegistrationMode::Full) const;
+    Transform GetRegisteredImageTransform(const cv::Mat &img, RegistrationMode mode = RegistrationMode::Full) const;
+    // Every scored rotation and scale candidate, best first, see
+    // `RegistrationOptions::rotationScaleCandidates` which must be set
+    std::vector<Transform> GetRegistrationCandidates(const cv::Mat &img) const;
+
+    // Finds the references that `img` matches without changing the current
+    // one. All references are ranked by the similarity of their rotation and
+    // scale invariant descriptors, and only the best `count` are registered on
+    // the thread pool. Returns their designations and transforms, highest
+    // response first.
+    std::vector<std::tuple<int, Transform>> SearchReferences(const cv::Mat &img, size_t count = 4, RegistrationMode mode = RegistrationMode::Full) const;
+
+    // Registers every image against the current reference on the thread pool.
+    // Results are in the order of `imgs`, all against the same reference even
+    // if it is changed while the batch runs.
+    std::vector<Transform> RegisterBatch(std::span<const cv::Mat> imgs, RegistrationMode mode = RegistrationMode::Full) const;
+    std::vector<std::tuple<cv::Mat, Transform>> GetRegisteredImageBatch(std::span<const cv::Mat> imgs, RegistrationMode mode = RegistrationMode::Full) const;
+
+    // Number of threads used by batches, including the caller. 0 uses all hardware threads.
+    void SetThreadCount(unsigned threadCount);
+
+    // Includes registrations of batches on the thread pool
+    std::vector<StageStats> GetStats() const;
+    void ResetStats();
 
 private:
-    int cols_, rows_;
+    // Entries of one reference share their index. The descriptors are stored
+    // back to back, so ranking every reference reads one contiguous block.
+    struct References{
+        int currentDesignation = -1;
+        std::vector<int> designations;
+        std::vector<std::shared_ptr<const ReferenceSpectra>> spectra;
+        std::vector<LogPolarDescriptor> descriptors;
+
+        std::optional<size_t> Find(int designation) const;
+        // Throws std::out_of_range if there is no such reference
+        const ReferenceSpectra& At(int designation) const;
+    };
+
+    std::shared_ptr<const References> GetReferences() const;
+    std::shared_ptr<ThreadPool> GetThreadPool() const;
+    Transform RegisterWithReference(const cv::Mat &img, const ReferenceSpectra& reference, RegistrationMode mode) const;
+
+    std::shared_ptr<const RegistrationPlan> plan_;
+
+    // Only guards swapping the pointer, never held during registration
+    mutable std::mutex referencesMutex_;
+    std::shared_ptr<const References> references_;
 
-    cv::Mat highPassFilter_;
-    cv::Mat apodizationWindow_;
-    LogPolarMap logPolarMap_;
+    // Created on the first batch
+    mutable std::mutex threadPoolMutex_;
+    unsigned threadCount_;
+    mutable std::shared_ptr<ThreadPool> threadPool_;
 
-    int currentDesignation_;
-    std::map<int, cv::Mat> references_;
-    std::map<int, cv::Mat> referenceLogPolars_;
+    [[no_unique_address]] mutable RegistrationStats stats_;
 };
 
-#endif // __FOURIER_MELLIN_H__
\ No newline at end of file
+#endif // __FOURIER_MELLIN_H__
@@ -0,0 +1,38 @@
+#include "fourier_mellin_fast.hpp"
+
+FourierMellinFast::FourierMellinFast(int cols, int rows, const RegistrationOptions& options):
+    FourierMellinFast(getRegistrationPlan(cols, rows, options))
+{
+}
+
+FourierMellinFast::FourierMellinFast(std::shared_ptr<const RegistrationPlan> plan):
+    plan_(std::move(plan)),
+    hasReference_(false)
+{
+}
+
+FourierMellinFast::~FourierMellinFast() {
+}
+
+void FourierMellinFast::SetReference(const cv::Mat &img) {
+    REGISTRATION_STATS_SCOPE(stats_);
+    reference_ = getReferenceSpectra(img, *plan_, buffers_);
+    hasReference_ = true;
+}
+
+Transform FourierMellinFast::GetTransform(const cv::Mat &img, RegistrationMode mode) {
+    if(!hasReference_){
+        throw std::runtime_error("Reference must be set before calling GetTransform.");
+    }
+
+    REGISTRATION_STATS_SCOPE(stats_);
+    return registerGrayImage(img, reference_, *plan_, buffers_, mode);
+}
+
+std::vector<StageStats> FourierMellinFast::GetStats() const {
+    return stats_.Get();
+}
+
+void FourierMellinFast::ResetStats() {
+    stats_.Reset();
+}
@@ -2,25 +2,39 @@
 #define __FOURIER_MELLIN_FAST_H__
 
 #include <iostream>
+#include <memory>
 
 #include "utilities.hpp"
 #include "transform.hpp"
+#include "registration_plan.hpp"
+#include "registration_plan_cache.hpp"
+#include "registration_stats.hpp"
 
+// Registration against a single reference for tight loops. The spectrums of
+// the reference are computed once in `SetReference`, and all intermediate
+// images live in buffers owned by the instance, so `GetTransform` does not
+// allocate after the first call. Not safe to share between threads, but the
+// plan may be shared with other instances.
 class FourierMellinFast{
 public:
-    FourierMellinFast(int cols, int rows);
+    FourierMellinFast(int cols, int rows, const RegistrationOptions& options = {});
+    FourierMellinFast(std::shared_ptr<const RegistrationPlan> plan);
     ~FourierMellinFast();
 
     void SetReference(const cv::Mat &img);
-    Transform GetTransform(const cv::Mat &img) const;
+    Transform GetTransform(const cv::Mat &img, RegistrationMode mode = RegistrationMode::Full);
+
+    std::vector<StageStats> GetStats() const;
+    void ResetStats();
 
 private:
-    cv::Mat highPassFilter_;
-    cv::Mat apodizationWindow_;
-    LogPolarMap logPolarMap_;
+    std::shared_ptr<const RegistrationPlan> plan_;
+
+    bool hasReference_;
+    ReferenceSpectra reference_;
 
-    cv::Mat reference_;
-    cv::Mat referenceLogPolar_;
+    RegistrationBuffers buffers_;
+    [[no_unique_address]] RegistrationStats stats_;
 };
 
-#endif // __FOURIER_MELLIN_FAST_H__
\ No newline at end of file
+#endif // __FOURIER_MELLIN_FAST_H__
@@ -1,4 +1,8 @@
 #include "fourier_mellin.hpp"
+#include "fourier_mellin_fast.hpp"
+#include "fourier_mellin_pipelined.hpp"
+#include "video_stabilization.hpp"
+#include "transform_trajectory.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <pybind11/pybind11.h>
@@ -6,6 +10,7 @@
 
 #include <iomanip>
 #include <sstream>
+#include <unordered_map>
 
 #ifndef MODULE_NAME
 #error "MODULE_NAME is not defined"
@@ -17,51 +22,71 @@
 namespace py = pybind11;
 using namespace pybind11::literals;
 
-template<unsigned int Channels>
-cv::Mat numpy_to_mat(const py::array_t<float>& input) {
-    py::buffer_info buf = input.request();
-    cv::Mat mat(buf.shape[0], buf.shape[1], CV_32FC(Channels), (float*)buf.ptr);
-    return mat;
+int numpy_dtype_to_depth(const py::dtype& dtype) {
+    if(dtype.is(py::dtype::of<uint8_t>())) return CV_8U;
+    if(dtype.is(py::dtype::of<uint16_t>())) return CV_16U;
+    if(dtype.is(py::dtype::of<float>())) return CV_32F;
+    return -1;
 }
 
-template<>
-cv::Mat numpy_to_mat<0>(const py::array_t<float>& input){
-    py::buffer_info buf = input.request();
-    int type;
-    int channels = buf.ndim == 3 ? buf.shape[2] : 1;
-
-    switch(channels){
-        case 1: type = CV_32FC1; break;
-        case 2: type = CV_32FC2; break;
-        case 3: type = CV_32FC3; break;
-        // case 4: type = CV_32FC4; break;
+py::dtype depth_to_numpy_dtype(int depth) {
+    switch(depth){
+        case CV_8U: return py::dtype::of<uint8_t>();
+        case CV_16U: return py::dtype::of<uint16_t>();
+        case CV_32F: return py::dtype::of<float>();
+        case CV_64F: return py::dtype::of<double>();
         default:
-            throw std::runtime_error("Invalid channel count: " + std::to_string(channels));
-            break;
+            throw std::runtime_error("Unsupported matrix depth: " + std::to_string(depth));
     }
-    cv::Mat mat(buf.shape[0], buf.shape[1], CV_32FC(channels), (float*)buf.ptr);
-    return mat;
 }
 
-py::array_t<float> mat_to_numpy(const cv::Mat& mat) {
-    py::ssize_t rows = mat.rows;
-    py::ssize_t cols = mat.cols;
-    py::ssize_t channels = mat.channels();
-    py::ssize_t total_size = rows * cols * channels;
-
-    std::vector<float> data(total_size);
-    if (mat.isContinuous()) {
-        std::memcpy(data.data(), mat.ptr<float>(), total_size * sizeof(float));
-    } else {
-        for (int i = 0; i < rows; ++i) {
-            std::memcpy(data.data() + i * cols * channels, mat.ptr<float>(i), cols * channels * sizeof(float));
+// Wraps the array without copying when OpenCV can address it, which is the
+// case for uint8, uint16 and float32 arrays whose pixels are packed
+// within a row. Rows may have any positive stride, so slices and crops are
+// wrapped as well. Other arrays are converted to a float32 copy owned by the
+// returned matrix. A wrapping matrix must not outlive `input`.
+cv::Mat numpy_to_mat(const py::array& input) {
+    if(input.ndim() != 2 && input.ndim() != 3){
+        throw std::runtime_error("Expected an image with 2 or 3 dimensions, got " + std::to_string(input.ndim()));
+    }
+    int channels = input.ndim() == 3 ? input.shape(2) : 1;
+    if(channels < 1 || channels > 4){
+        throw std::runtime_error("Invalid channel count: " + std::to_string(channels));
+    }
+
+    int depth = numpy_dtype_to_depth(input.dtype());
+    auto itemSize = input.itemsize();
+    bool packedPixels = (input.ndim() == 2 || channels == 1 || input.strides(2) == itemSize)
+        && input.strides(1) == itemSize * channels;
+    bool validRows = input.strides(0) >= input.strides(1) * input.shape(1) && input.strides(0) % itemSize == 0;
+    if(depth < 0 || !packedPixels || !validRows){
+        auto contiguous = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(input);
+        if(!contiguous){
+            throw py::error_already_set();
         }
+        return numpy_to_mat(contiguous).clone();
     }
 
-    return py::array_t<float>(
-        {rows, cols, channels},
-        {cols * channels * sizeof(float), channels * sizeof(float), sizeof(float)},
-        data.data()
+    return cv::Mat(input.shape(0), input.shape(1), CV_MAKETYPE(depth, channels), const_cast<void*>(input.data()), input.strides(0));
+}
+
+// Returns an array of shape (rows, cols, channels) that shares the buffer of
+// `mat` and keeps it alive through a capsule. Matrices that wrap external
+// memory are copied first, since their buffer is not reference counted.
+py::array mat_to_numpy(const cv::Mat& mat) {
+    auto* owner = new cv::Mat(mat.u ? mat : mat.clone());
+    py::capsule base(owner, [](void* p){
+        delete reinterpret_cast<cv::Mat*>(p);
+    });
+
+    py::ssize_t elemSize = owner->elemSize();
+    py::ssize_t elemSize1 = owner->elemSize1();
+    return py::array(
+        depth_to_numpy_dtype(owner->depth()),
+        {(py::ssize_t)owner->rows, (py::ssize_t)owner->cols, (py::ssize_t)owner->channels()},
+        {(py::ssize_t)owner->step[0], elemSize, elemSize1},
+        owner->data,
+        base
     );
 }
 
@@ -75,8 +100,8 @@ struct PyLogPolarMap{
         return PyLogPolarMap{
             .logPolarSize = polarMap.logPolarSize,
             .logBase = polarMap.logBase,
-            .xMap = mat_to_numpy(polarMap.xMap),
-            .yMap = mat_to_numpy(polarMap.yMap),
+            .xMap = py::cast<py::array_t<float>>(mat_to_numpy(polarMap.xMap)),
+            .yMap = py::cast<py::array_t<float>>(mat_to_numpy(polarMap.yMap)),
         };
     }
 
@@ -84,12 +109,96 @@ struct PyLogPolarMap{
         return LogPolarMap{
             .logPolarSize = logPolarSize,
             .logBase = logBase,
-            .xMap = numpy_to_mat<1>(xMap),
-            .yMap = numpy_to_mat<1>(yMap),
+            .xMap = numpy_to_mat(xMap),
+            .yMap = numpy_to_mat(yMap),
         };
     }
 };
 
+// The mats point into `arrays`, which must outlive them
+std::vector<cv::Mat> list_to_mats(const py::list& imgs, std::vector<py::array>& arrays) {
+    std::vector<cv::Mat> mats;
+    arrays.reserve(imgs.size());
+    mats.reserve(imgs.size());
+    for(const auto& img : imgs){
+        if(!py::isinstance<py::array>(img)){
+            throw std::runtime_error("List element is not a NumPy array.");
+        }
+        arrays.push_back(py::reinterpret_borrow<py::array>(img));
+        mats.push_back(numpy_to_mat(arrays.back()));
+    }
+    return mats;
+}
+
+// One row per transform: x, y, scale, rotation, response
+py::array_t<double> transforms_to_numpy(const std::vector<Transform>& transforms) {
+    py::array_t<double> result({(py::ssize_t)transforms.size(), (py::ssize_t)5});
+    auto rows = result.mutable_unchecked<2>();
+    for(size_t i=0; i<transforms.size(); i++){
+        const auto& t = transforms[i];
+        rows(i, 0) = t.GetOffsetX();
+        rows(i, 1) = t.GetOffsetY();
+        rows(i, 2) = t.GetScale();
+        rows(i, 3) = t.GetRotation();
+        rows(i, 4) = t.GetResponse();
+    }
+    return result;
+}
+
+// Numpy arrays alive over the parameters of each trajectory. Appending could
+// reallocate the parameters under them, so it is refused while any exist.
+// Only touched with the GIL held.
+static std::unordered_map<const TransformTrajectory*, size_t> trajectoryViewCounts;
+
+// Base of the views, keeps the trajectory alive and counts its views
+struct TrajectoryViewOwner{
+    explicit TrajectoryViewOwner(py::object self):
+        self(std::move(self)),
+        trajectory(this->self.cast<const TransformTrajectory*>())
+    {
+        trajectoryViewCounts[trajectory]++;
+    }
+    ~TrajectoryViewOwner(){
+        if(--trajectoryViewCounts[trajectory] == 0){
+            trajectoryViewCounts.erase(trajectory);
+        }
+    }
+
+    py::object self;
+    const TransformTrajectory* trajectory;
+};
+
+// Array over one parameter array of the trajectory in `self`, kept alive by the array
+py::array_t<double> trajectory_view(py::object self, std::span<double> (TransformTrajectory::*parameter)()) {
+    auto& trajectory = self.cast<TransformTrajectory&>();
+    auto values = (trajectory.*parameter)();
+    py::capsule owner(new TrajectoryViewOwner(std::move(self)), [](void* owner){
+        delete static_cast<TrajectoryViewOwner*>(owner);
+    });
+    return py::array_t<double>(values.size(), values.data(), owner);
+}
+
+// Stage name to a dict of its counters and timings in milliseconds
+py::dict stats_to_dict(const std::vector<StageStats>& stats) {
+    py::dict result;
+    for(const auto& stage : stats){
+        py::dict d;
+        d["calls"] = stage.calls;
+        d["allocations"] = stage.allocations;
+        d["total_ms"] = stage.totalMilliseconds;
+        d["p50_ms"] = stage.p50Milliseconds;
+        d["p90_ms"] = stage.p90Milliseconds;
+        d["p99_ms"] = stage.p99Milliseconds;
+        result[py::str(stage.stage)] = d;
+    }
+    return result;
+}
+
+// Holds the plan so that several registration objects can share it
+struct PyRegistrationPlan{
+    std::shared_ptr<const RegistrationPlan> plan;
+};
+
 template <typename T>
 std::string to_string_with_precision(const T value, const int n=2){
     std::ostringstream out;
@@ -98,7 +207,18 @@ std::string to_string_with_precision(const T value, const int n=2){
     return std::move(out).str();
 }
 
+// Same stats methods on every registration class
+#define STATS_METHODS(Class) \
+        .def("stats", [](const Class& fm) -> auto { \
+            return stats_to_dict(fm.GetStats()); \
+        }, "Per-stage call counts, allocations and timings in milliseconds. All zero unless built with FOURIER_MELLIN_STATS.") \
+        .def("reset_stats", [](Class& fm) -> auto { \
+            fm.ResetStats(); \
+        }, "Reset Stats")
+
 PYBIND11_MODULE(MODULE_NAME, m) {
+    m.attr("stats_enabled") = registrationStatsEnabled;
+
     py::class_<Transform>(m, "Transform")
         .def(py::init<>())
         .def(py::init<double, double, double, double, double>())
@@ -157,6 +277,94 @@ PYBIND11_MODULE(MODULE_NAME, m) {
             return py::dict("x"_a=t.GetOffsetX(), "y"_a=t.GetOffsetY(), "scale"_a=t.GetScale(), "rotation"_a=t.GetRotation(), "response"_a=t.GetResponse());
         });
         
+    py::class_<TransformTrajectory>(m, "TransformTrajectory")
+        .def(py::init<>())
+        .def(py::init([](const py::array_t<double, py::array::c_style | py::array::forcecast>& transforms){
+            if(transforms.ndim() != 2 || transforms.shape(1) != 5){
+                throw std::runtime_error("Expected an N x 5 array with columns x, y, scale, rotation and response.");
+            }
+            auto rows = transforms.unchecked<2>();
+            TransformTrajectory trajectory(rows.shape(0));
+            for(py::ssize_t i=0; i<rows.shape(0); i++){
+                trajectory.OffsetsX()[i] = rows(i, 0);
+                trajectory.OffsetsY()[i] = rows(i, 1);
+                trajectory.Scales()[i] = rows(i, 2);
+                trajectory.Rotations()[i] = rows(i, 3);
+                trajectory.Responses()[i] = rows(i, 4);
+            }
+            return trajectory;
+        }), "From an N x 5 array with columns x, y, scale, rotation and response, as returned by the batched registrations.", "transforms"_a)
+        .def(py::init([](const py::list& transforms){
+            TransformTrajectory trajectory;
+            for(const auto& transform : transforms){
+                trajectory.PushBack(transform.cast<Transform>());
+            }
+            return trajectory;
+        }), "From a list of Transforms.", "transforms"_a)
+        .def("__len__", &TransformTrajectory::Size)
+        .def("__getitem__", &TransformTrajectory::Get)
+        .def("__setitem__", &TransformTrajectory::Set)
+        .def("append", [](TransformTrajectory& trajectory, const Transform& transform){
+            if(trajectoryViewCounts.contains(&trajectory)){
+                throw py::buffer_error("Cannot append while views of the trajectory exist, delete or copy them first.");
+            }
+            trajectory.PushBack(transform);
+        }, "Append a transform. Raises BufferError while arrays from x, y, scale, rotation or response are alive.")
+        .def_property_readonly("x", [](py::object self){ return trajectory_view(self, &TransformTrajectory::OffsetsX); },
+            "Writable view of the x offsets. The trajectory cannot be appended to while the view is alive.")
+        .def_property_readonly("y", [](py::object self){ return trajectory_view(self, &TransformTrajectory::OffsetsY); })
+        .def_property_readonly("scale", [](py::object self){ return trajectory_view(self, &TransformTrajectory::Scales); })
+        .def_property_readonly("rotation", [](py::object self){ return trajectory_view(self, &TransformTrajectory::Rotations); })
+        .def_property_readonly("response", [](py::object self){ return trajectory_view(self, &TransformTrajectory::Responses); })
+        .def("to_numpy", [](const TransformTrajectory& trajectory){
+            return transforms_to_numpy(trajectory.GetTransforms());
+        }, "N x 5 array with columns x, y, scale, rotation and response.")
+        .def("cumulative", &TransformTrajectory::GetCumulative, "Element i is t_i * ... * t_0.")
+        .def("inverse", &TransformTrajectory::GetInverse, "Element-wise inverses.")
+        .def("__mul__", [](const TransformTrajectory& a, const TransformTrajectory& b){ return a * b; }, py::is_operator())
+        .def("__mul__", [](const TransformTrajectory& a, const Transform& b){ return a * b; }, py::is_operator())
+        .def("moving_average", &TransformTrajectory::GetMovingAverage, "Moving average over `radius` neighbors on both sides.", "radius"_a)
+        .def("gaussian", &TransformTrajectory::GetGaussianSmoothed, "Gaussian smoothing with standard deviation `sigma` frames.", "sigma"_a)
+        .def("kalman", &TransformTrajectory::GetKalmanSmoothed, "Kalman smoothing of a random walk.", "process_noise"_a, "measurement_noise"_a);
+
+    py::class_<RegistrationOptions>(m, "RegistrationOptions")
+        .def(py::init<>())
+        .def_readwrite("pad_to_optimal_dft_size", &RegistrationOptions::padToOptimalDftSize)
+        .def_readwrite("fixed_point_log_polar_map", &RegistrationOptions::fixedPointLogPolarMap)
+        .def_readwrite("pyramid_levels", &RegistrationOptions::pyramidLevels)
+        .def_readwrite("rotation_scale_candidates", &RegistrationOptions::rotationScaleCandidates)
+        .def_readwrite("auto_mode_response_threshold", &RegistrationOptions::autoModeResponseThreshold);
+
+    py::class_<KeyframeOptions>(m, "KeyframeOptions")
+        .def(py::init<>())
+        .def_readwrite("enabled", &KeyframeOptions::enabled)
+        .def_readwrite("min_response", &KeyframeOptions::minResponse)
+        .def_readwrite("max_offset", &KeyframeOptions::maxOffset)
+        .def_readwrite("max_rotation", &KeyframeOptions::maxRotation)
+        .def_readwrite("max_scale_change", &KeyframeOptions::maxScaleChange);
+
+    py::enum_<RegistrationMode>(m, "RegistrationMode")
+        .value("FULL", RegistrationMode::Full)
+        .value("TRANSLATION_ONLY", RegistrationMode::TranslationOnly)
+        .value("AUTO", RegistrationMode::Auto);
+
+    py::class_<PyRegistrationPlan>(m, "RegistrationPlan")
+        .def(py::init([](int cols, int rows, const RegistrationOptions& options){
+            return PyRegistrationPlan{getRegistrationPlan(cols, rows, options)};
+        }), "Plan from the process-wide cache, created on first use.", "cols"_a, "rows"_a, "options"_a = RegistrationOptions{})
+        .def_property_readonly("cols", [](const PyRegistrationPlan& p){ return p.plan->cols; })
+        .def_property_readonly("rows", [](const PyRegistrationPlan& p){ return p.plan->rows; })
+        .def("save", [](const PyRegistrationPlan& p, const std::string& path){
+            saveRegistrationPlan(*p.plan, path);
+        }, "Save the plan to a binary file for `load`.", "path"_a)
+        .def_static("load", [](const std::string& path, bool verify){
+            return PyRegistrationPlan{loadRegistrationPlan(path, verify)};
+        }, "Memory-map a plan saved with `save`. `verify` also checks the checksum of the whole file.", "path"_a, "verify"_a = false);
+
+    m.def("set_plan_cache_directory", &setRegistrationPlanCacheDirectory,
+        "Keep cached plans as files in this directory and load them from there. An empty string keeps plans in memory only.", "directory"_a);
+    m.def("clear_plan_cache", &clearRegistrationPlanCache, "Drop the cached plans from memory.");
+
     py::class_<PyLogPolarMap>(m, "LogPolarMap")
         .def(py::init<>())
         .def_readwrite("log_polar_size", &PyLogPolarMap::logPolarSize)
@@ -166,31 +374,68 @@ PYBIND11_MODULE(MODULE_NAME, m) {
 
     py::class_<FourierMellin>(m, "FourierMellin")
         .def(py::init<int, int>())
-        .def("process_image", [](const FourierMellin& fm, py::array_t<float> img) -> auto {
-            auto mat = numpy_to_mat<1>(img);
+        .def(py::init<int, int, RegistrationOptions>())
+        .def(py::init([](const PyRegistrationPlan& p){ return new FourierMellin(p.plan); }))
+        .def("process_image", [](const FourierMellin& fm, const py::array& img) -> auto {
+            auto mat = numpy_to_mat(img);
             auto matProcessed = fm.GetProcessImage(mat);
             return mat_to_numpy(matProcessed);
         }, "Process Image")
-        .def("register_image", [](const FourierMellin& fm, const py::array_t<float>& img0, const py::array_t<float>& img1) -> auto {
-            auto mat0 = numpy_to_mat<0>(img0);
-            auto mat1 = numpy_to_mat<0>(img1);
+        .def("register_image", [](const FourierMellin& fm, const py::array& img0, const py::array& img1) -> auto {
+            auto mat0 = numpy_to_mat(img0);
+            auto mat1 = numpy_to_mat(img1);
             auto[transformed, transform] = fm.GetRegisteredImage(mat0, mat1);
             return std::make_tuple(mat_to_numpy(transformed), transform);
-        }, "Register Image");
+        }, "Register Image")
+        STATS_METHODS(FourierMellin);
 
     py::class_<FourierMellinContinuous>(m, "FourierMellinContinuous")
         .def(py::init<int, int>())
         .def(py::init<int, int, double, double>())
-        .def("register_image", [](FourierMellinContinuous& fm, const py::array_t<float>& img) -> auto {
-            auto mat0 = numpy_to_mat<0>(img);
+        .def(py::init<int, int, double, double, RegistrationOptions>())
+        .def(py::init<int, int, double, double, RegistrationOptions, KeyframeOptions>())
+        .def("register_image", [](FourierMellinContinuous& fm, const py::array& img) -> auto {
+            auto mat0 = numpy_to_mat(img);
             auto[transformed, transform] = fm.GetRegisteredImage(mat0);
             return std::make_tuple(mat_to_numpy(transformed), transform);
-        }, "Register Image");
+        }, "Register Image")
+        .def("keyframe_count", &FourierMellinContinuous::GetKeyframeCount, "Keyframes taken so far including the first frame.")
+        STATS_METHODS(FourierMellinContinuous);
+
+    py::class_<FourierMellinContinuousPipelined>(m, "FourierMellinContinuousPipelined")
+        .def(py::init<int, int>())
+        .def(py::init<int, int, double, double>())
+        .def(py::init<int, int, double, double, size_t>())
+        .def(py::init<int, int, double, double, size_t, RegistrationOptions>())
+        .def(py::init<int, int, double, double, size_t, RegistrationOptions, KeyframeOptions>())
+        .def("push_image", [](FourierMellinContinuousPipelined& fm, const py::array& img) -> auto {
+            auto mat = numpy_to_mat(img);
+            pybind11::gil_scoped_release release;
+            fm.PushImage(mat);
+        }, "Queue an image, blocks while the pipeline is full.")
+        .def("pop_registered_image", [](FourierMellinContinuousPipelined& fm) -> py::object {
+            std::optional<std::tuple<cv::Mat, Transform>> result;
+            {
+                pybind11::gil_scoped_release release;
+                result = fm.PopRegisteredImage();
+            }
+            if(!result){
+                return py::none();
+            }
+            auto&[transformed, transform] = *result;
+            return py::make_tuple(mat_to_numpy(transformed), transform);
+        }, "Result of the oldest queued image, None once finished and drained.")
+        .def("finish", [](FourierMellinContinuousPipelined& fm) -> auto {
+            fm.Finish();
+        }, "No more images will be pushed.")
+        STATS_METHODS(FourierMellinContinuousPipelined);
 
     py::class_<FourierMellinWithReference>(m, "FourierMellinWithReference")
         .def(py::init<int, int>())
-        .def("set_reference", [](FourierMellinWithReference& fm, const py::array_t<float>& img, int designation=-1) -> auto {
-            auto mat = numpy_to_mat<0>(img);
+        .def(py::init<int, int, RegistrationOptions>())
+        .def(py::init([](const PyRegistrationPlan& p){ return new FourierMellinWithReference(p.plan); }))
+        .def("set_reference", [](FourierMellinWithReference& fm, const py::array& img, int designation=-1) -> auto {
+            auto mat = numpy_to_mat(img);
             pybind11::gil_scoped_release release;
             fm.SetReference(mat, designation);
             pybind11::gil_scoped_acquire acquire;
@@ -198,84 +443,95 @@ PYBIND11_MODULE(MODULE_NAME, m) {
         .def("set_reference_with_designation", [](FourierMellinWithReference& fm, int designation) -> auto {
             fm.SetReferenceWithDesignation(designation);
         }, "Set Reference")
-        .def("register_image", [](FourierMellinWithReference& fm, const py::array_t<float>& img) -> auto {
-            auto mat = numpy_to_mat<0>(img);
+        .def("register_image", [](FourierMellinWithReference& fm, const py::array& img, RegistrationMode mode) -> auto {
+            auto mat = numpy_to_mat(img);
             pybind11::gil_scoped_release release;
-            auto[transformed, transform] = fm.GetRegisteredImage(mat);
+            auto[transformed, transform] = fm.GetRegisteredImage(mat, mode);
             pybind11::gil_scoped_acquire acquire;
             return std::make_tuple(mat_to_numpy(transformed), transform);
-        }, "Register Image")
-        .def("register_image_only_transform", [](FourierMellinWithReference& fm, const py::array_t<float>& img) -> auto {
-            auto mat = numpy_to_mat<0>(img);
+        }, "Register Image", "img"_a, "mode"_a = RegistrationMode::Full)
+        .def("register_image_only_transform", [](FourierMellinWithReference& fm, const py::array& img, RegistrationMode mode) -> auto {
+            auto mat = numpy_to_mat(img);
+            pybind11::gil_scoped_release release;
+            return fm.GetRegisteredImageTransform(mat, mode);
+        }, "Register Image but return only the transform.", "img"_a, "mode"_a = RegistrationMode::Full)
+        .def("register_image_candidates", [](FourierMellinWithReference& fm, const py::array& img) -> auto {
+            auto mat = numpy_to_mat(img);
             pybind11::gil_scoped_release release;
-            auto[transformed, transform] = fm.GetRegisteredImage(mat);
-            // pybind11::gil_scoped_acquire acquire;
-            return transform;
-        }, "Register Image but return only the transform.")
-        .def("register_image_batched", [](FourierMellinWithReference& fm, const py::list imgs) -> auto {
-            std::vector<cv::Mat> imgsMat;
+            return fm.GetRegistrationCandidates(mat);
+        }, "Every scored rotation and scale candidate, best first. Requires rotation_scale_candidates in the options.")
+        .def("search_references", [](FourierMellinWithReference& fm, const py::array& img, size_t count, RegistrationMode mode) -> auto {
+            auto mat = numpy_to_mat(img);
+            pybind11::gil_scoped_release release;
+            return fm.SearchReferences(mat, count, mode);
+        }, "Designations and transforms of the references `img` matches best, highest response first. Only the `count` references with the most similar descriptors are registered.", "img"_a, "count"_a = 4, "mode"_a = RegistrationMode::Full)
+        .def("set_thread_count", [](FourierMellinWithReference& fm, unsigned threadCount) -> auto {
+            fm.SetThreadCount(threadCount);
+        }, "Set the number of threads used by batched registration, 0 uses all hardware threads.")
+        .def("register_image_batched", [](FourierMellinWithReference& fm, const py::list imgs, RegistrationMode mode) -> auto {
+            std::vector<py::array> arrays;
+            auto imgsMat = list_to_mats(imgs, arrays);
             std::vector<std::tuple<cv::Mat, Transform>> results;
-            unsigned imgsSize = imgs.size();
-            imgsMat.reserve(imgsSize);
-            results.reserve(imgsSize);
-
-            for(const auto& img : imgs){
-                if(!py::isinstance<py::array>(img)){
-                    throw std::runtime_error("List element is not a NumPy array.");
-                }
-                auto mat = numpy_to_mat<0>(py::cast<py::array_t<float>>(img));
-                imgsMat.push_back(mat);
-            }
-
             {
                 pybind11::gil_scoped_release release;
-                for(const auto& mat : imgsMat){
-                    auto[transformed, transform] = fm.GetRegisteredImage(mat);
-                    results.push_back(std::make_tuple(transformed, transform));
-                }
-            }
-            
-            pybind11::gil_scoped_acquire acquire;
-            py::list pyresults;
-
-            for(const auto&[transformed, transform] : results){
-                pyresults.append(py::make_tuple(mat_to_numpy(transformed), transform));
+                results = fm.GetRegisteredImageBatch(imgsMat, mode);
             }
 
-            return pyresults;
-        }, "Register image in batches.")
-        .def("register_image_batched_only_transform", [](FourierMellinWithReference& fm, const py::list imgs) -> auto {
-            std::vector<cv::Mat> imgsMat;
-            std::vector<Transform> results;
-            unsigned imgsSize = imgs.size();
-            imgsMat.reserve(imgsSize);
-            results.reserve(imgsSize);
-
-            for(const auto& img : imgs){
-                if(!py::isinstance<py::array>(img)){
-                    throw std::runtime_error("List element is not a NumPy array.");
-                }
-                auto mat = numpy_to_mat<0>(py::cast<py::array_t<float>>(img));
-                imgsMat.push_back(mat);
+            py::list transformed;
+            std::vector<Transform> transforms;
+            transforms.reserve(results.size());
+            for(const auto&[img, transform] : results){
+                transformed.append(mat_to_numpy(img));
+                transforms.push_back(transform);
             }
-
+            return std::make_tuple(transformed, transforms_to_numpy(transforms));
+        }, "Register images in parallel. Returns the list of transformed images and an array of transforms, see `register_image_batched_only_transform`.", "imgs"_a, "mode"_a = RegistrationMode::Full)
+        .def("register_image_batched_only_transform", [](FourierMellinWithReference& fm, const py::list imgs, RegistrationMode mode) -> auto {
+            std::vector<py::array> arrays;
+            auto imgsMat = list_to_mats(imgs, arrays);
+            std::vector<Transform> transforms;
             {
                 pybind11::gil_scoped_release release;
-                for(const auto& mat : imgsMat){
-                    const auto& transform = fm.GetRegisteredImageTransform(mat);
-                    results.push_back(transform);
-                }
+                transforms = fm.RegisterBatch(imgsMat, mode);
             }
-            
-            pybind11::gil_scoped_acquire acquire;
-            py::list pyresults;
+            return transforms_to_numpy(transforms);
+        }, "Register images in parallel without returning transformed images. Returns an N x 5 array with columns x, y, scale, rotation and response.", "imgs"_a, "mode"_a = RegistrationMode::Full)
+        STATS_METHODS(FourierMellinWithReference);
 
-            for(const auto& transform : results){
-                pyresults.append(transform);
-            }
+    py::class_<FourierMellinFast>(m, "FourierMellinFast")
+        .def(py::init<int, int>())
+        .def(py::init<int, int, RegistrationOptions>())
+        .def(py::init([](const PyRegistrationPlan& p){ return new FourierMellinFast(p.plan); }))
+        .def("set_reference", [](FourierMellinFast& fm, const py::array& img) -> auto {
+            auto mat = numpy_to_mat(img);
+            pybind11::gil_scoped_release release;
+            fm.SetReference(mat);
+        }, "Set Reference")
+        .def("get_transform", [](FourierMellinFast& fm, const py::array& img, RegistrationMode mode) -> auto {
+            auto mat = numpy_to_mat(img);
+            pybind11::gil_scoped_release release;
+            return fm.GetTransform(mat, mode);
+        }, "Register Image against the reference and return only the transform.", "img"_a, "mode"_a = RegistrationMode::Full)
+        STATS_METHODS(FourierMellinFast);
 
-            return pyresults;
-        }, "Register image in batches without returning transformed images.");
+    py::class_<StabilizationOptions>(m, "StabilizationOptions")
+        .def(py::init<>())
+        .def_readwrite("edge_crop", &StabilizationOptions::edgeCrop)
+        .def_readwrite("pull_to_center_ratio", &StabilizationOptions::pullToCenterRatio)
+        .def_readwrite("queue_depth", &StabilizationOptions::queueDepth)
+        .def_readwrite("fourcc", &StabilizationOptions::fourcc)
+        .def_readwrite("registration", &StabilizationOptions::registration)
+        .def_readwrite("keyframes", &StabilizationOptions::keyframes);
+
+    m.def("stabilize_video", [](const std::string& input, const std::string& output, const StabilizationOptions& options){
+        std::vector<Transform> transforms;
+        {
+            pybind11::gil_scoped_release release;
+            transforms = StabilizeVideo(input, output, options);
+        }
+        return transforms_to_numpy(transforms);
+    }, "Stabilize a video file into another without leaving C++. Returns the total transform of every frame like `register_image_batched_only_transform`.",
+        "input"_a, "output"_a, "options"_a = StabilizationOptions{});
 
     m.def("get_filters", [](int cols, int rows) -> auto {
         auto highPassFilter = getHighPassFilter(rows, cols);
@@ -292,26 +548,26 @@ PYBIND11_MODULE(MODULE_NAME, m) {
         return PyLogPolarMap::ConvertFromLogPolarMap(polarMap);
     }, "Do something");
 
-    m.def("process_image", [](const py::array_t<float>& img, const py::array_t<float>& highPassFilter, const py::array_t<float>& apodizationWindow, PyLogPolarMap logPolarMap){
+    m.def("process_image", [](const py::array& img, const py::array& highPassFilter, const py::array& apodizationWindow, PyLogPolarMap logPolarMap){
         auto logPolarMap2 = logPolarMap.ConvertToLogPolarMap();
-        auto img2 = numpy_to_mat<1>(img);
-        auto highPassFilter2 = numpy_to_mat<2>(highPassFilter);
-        auto apodizationWindow2 = numpy_to_mat<1>(apodizationWindow);
+        auto img2 = numpy_to_mat(img);
+        auto highPassFilter2 = numpy_to_mat(highPassFilter);
+        auto apodizationWindow2 = numpy_to_mat(apodizationWindow);
         auto logPolarImg = getProcessedImage(img2, highPassFilter2, apodizationWindow2, logPolarMap2);
         return mat_to_numpy(logPolarImg);
     }, "Process Image");
 
-    m.def("register_image", [](const py::array_t<float>& img0, const py::array_t<float>& img1, const py::array_t<float>& logPolar0, const py::array_t<float>& logPolar1, PyLogPolarMap logPolarMap){
-        auto mat0 = numpy_to_mat<1>(img0);
-        auto mat1 = numpy_to_mat<1>(img1);
-        auto matLogPolar0 = numpy_to_mat<1>(logPolar0);
-        auto matLogPolar1 = numpy_to_mat<1>(logPolar1);
+    m.def("register_image", [](const py::array& img0, const py::array& img1, const py::array& logPolar0, const py::array& logPolar1, PyLogPolarMap logPolarMap){
+        auto mat0 = numpy_to_mat(img0);
+        auto mat1 = numpy_to_mat(img1);
+        auto matLogPolar0 = numpy_to_mat(logPolar0);
+        auto matLogPolar1 = numpy_to_mat(logPolar1);
         auto logPolarMap2 = logPolarMap.ConvertToLogPolarMap();
         return registerGrayImage(mat0, mat1, matLogPolar0, matLogPolar1, logPolarMap2);
     }, "Register Images");
 
-    m.def("get_transformed", [](const py::array_t<float>& img, Transform transform){
-        auto mat = numpy_to_mat<0>(img);
+    m.def("get_transformed", [](const py::array& img, Transform transform){
+        auto mat = numpy_to_mat(img);
         auto transformed = getTransformed(mat, transform);
         return mat_to_numpy(transformed);
     }, "Process Image");
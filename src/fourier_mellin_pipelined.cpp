@@ -0,0 +1,108 @@
+#include "fourier_mellin_pipelined.hpp"
+
+FourierMellinContinuousPipelined::FourierMellinContinuousPipelined(int cols, int rows, double edgeCrop, double pullToCenterRatio, size_t depth, const RegistrationOptions& options, const KeyframeOptions& keyframes):
+    continuous_(cols, rows, edgeCrop, pullToCenterRatio, options, keyframes),
+    input_(depth),
+    preprocessed_(depth),
+    accumulated_(depth),
+    output_(depth),
+    preprocessThread_(&FourierMellinContinuousPipelined::PreprocessLoop, this),
+    accumulateThread_(&FourierMellinContinuousPipelined::AccumulateLoop, this),
+    warpThread_(&FourierMellinContinuousPipelined::WarpLoop, this)
+{
+}
+
+FourierMellinContinuousPipelined::~FourierMellinContinuousPipelined() {
+    // Closing every queue also releases stages blocked on a full queue
+    input_.Close();
+    preprocessed_.Close();
+    accumulated_.Close();
+    output_.Close();
+    preprocessThread_.join();
+    accumulateThread_.join();
+    warpThread_.join();
+}
+
+void FourierMellinContinuousPipelined::PushImage(const cv::Mat &img) {
+    if(!input_.Push(img.clone())){
+        throw std::runtime_error("Cannot push images after Finish.");
+    }
+}
+
+std::optional<std::tuple<cv::Mat, Transform>> FourierMellinContinuousPipelined::PopRegisteredImage() {
+    auto item = output_.Pop();
+    if(!item){
+        return std::nullopt;
+    }
+    if(item->error){
+        std::rethrow_exception(item->error);
+    }
+    if(!item->totalTransform){
+        return std::make_tuple(cv::Mat(), Transform{});
+    }
+    return std::make_tuple(item->warped, *item->totalTransform);
+}
+
+void FourierMellinContinuousPipelined::Finish() {
+    input_.Close();
+}
+
+std::vector<StageStats> FourierMellinContinuousPipelined::GetStats() const {
+    return continuous_.GetStats();
+}
+
+void FourierMellinContinuousPipelined::ResetStats() {
+    continuous_.ResetStats();
+}
+
+void FourierMellinContinuousPipelined::PreprocessLoop() {
+    while(auto img = input_.Pop()){
+        Item item;
+        try{
+            item.frame = continuous_.Preprocess(*img);
+        }
+        catch(...){
+            item.error = std::current_exception();
+        }
+        if(!preprocessed_.Push(std::move(item))){
+            return;
+        }
+    }
+    preprocessed_.Close();
+}
+
+void FourierMellinContinuousPipelined::AccumulateLoop() {
+    while(auto item = preprocessed_.Pop()){
+        if(!item->error){
+            try{
+                item->totalTransform = continuous_.Accumulate(item->frame);
+            }
+            catch(...){
+                item->error = std::current_exception();
+            }
+        }
+        if(!accumulated_.Push(std::move(*item))){
+            return;
+        }
+    }
+    accumulated_.Close();
+}
+
+void FourierMellinContinuousPipelined::WarpLoop() {
+    while(auto item = accumulated_.Pop()){
+        if(!item->error && item->totalTransform){
+            try{
+                item->warped = continuous_.Warp(item->frame.img, *item->totalTransform);
+            }
+            catch(...){
+                item->error = std::current_exception();
+            }
+        }
+        // Previous frames are only needed by the accumulate stage
+        item->frame = {};
+        if(!output_.Push(std::move(*item))){
+            return;
+        }
+    }
+    output_.Close();
+}
@@ -0,0 +1,63 @@
+#ifndef __FOURIER_MELLIN_PIPELINED_H__
+#define __FOURIER_MELLIN_PIPELINED_H__
+
+#include <exception>
+#include <optional>
+#include <thread>
+
+#include "fourier_mellin.hpp"
+#include "bounded_queue.hpp"
+
+// FourierMellinContinuous with its stages on separate threads: while frame N
+// is correlated against frame N-1, frame N+1 is preprocessed and frame N-1 is
+// warped. Results come out in input order and are identical to the serial
+// `FourierMellinContinuous::GetRegisteredImage`.
+//
+// Every queue between the stages holds at most `depth` frames. When they are
+// full, `PushImage` blocks until `PopRegisteredImage` makes room. Push and pop
+// may be called from different threads, but each from only one at a time.
+class FourierMellinContinuousPipelined{
+public:
+    FourierMellinContinuousPipelined(int cols, int rows, double edgeCrop = 0.1, double pullToCenterRatio = 0.07, size_t depth = 2, const RegistrationOptions& options = {}, const KeyframeOptions& keyframes = {});
+    ~FourierMellinContinuousPipelined();
+
+    // `img` is copied, so the caller may reuse its buffer right away
+    void PushImage(const cv::Mat &img);
+
+    // Result of the oldest pushed frame, blocks until it is ready. The first
+    // frame gives an empty image like in FourierMellinContinuous. Returns an
+    // empty optional once `Finish` was called and all results were popped.
+    // Rethrows errors of the stages.
+    std::optional<std::tuple<cv::Mat, Transform>> PopRegisteredImage();
+
+    // No more frames will be pushed
+    void Finish();
+
+    std::vector<StageStats> GetStats() const;
+    void ResetStats();
+
+private:
+    struct Item{
+        FourierMellinContinuous::Frame frame;
+        std::optional<Transform> totalTransform;
+        cv::Mat warped;
+        std::exception_ptr error;
+    };
+
+    void PreprocessLoop();
+    void AccumulateLoop();
+    void WarpLoop();
+
+    FourierMellinContinuous continuous_;
+
+    BoundedQueue<cv::Mat> input_;
+    BoundedQueue<Item> preprocessed_;
+    BoundedQueue<Item> accumulated_;
+    BoundedQueue<Item> output_;
+
+    std::thread preprocessThread_;
+    std::thread accumulateThread_;
+    std::thread warpThread_;
+};
+
+#endif // __FOURIER_MELLIN_PIPELINED_H__
@@ -0,0 +1,210 @@
+#include "registration_plan.hpp"
+#include "registration_stats.hpp"
+
+#include <algorithm>
+
+// The translation is refined on a central window of this many pixels of the
+// processing size in each dimension, so it grows with the pyramid levels
+constexpr int refinementWindowCoarseSize = 64;
+// The coarse estimate is within about a pixel of the processing size, so its
+// correction is searched within this many of them
+constexpr int refinementSearchCoarseRadius = 2;
+
+// Larger dimension of the image on which rotation and scale candidates are scored
+constexpr int scoringDimension = 128;
+
+std::shared_ptr<const RegistrationPlan> createRegistrationPlan(int cols, int rows, const RegistrationOptions& options) {
+    CV_Assert(options.pyramidLevels >= 0);
+    auto processingSize = cv::Size(std::max(cols >> options.pyramidLevels, 1), std::max(rows >> options.pyramidLevels, 1));
+    auto refinementSize = cv::Size(
+        std::min(cols, refinementWindowCoarseSize << options.pyramidLevels),
+        std::min(rows, refinementWindowCoarseSize << options.pyramidLevels)
+    );
+    if(options.pyramidLevels == 0){
+        refinementSize = cv::Size(cols, rows);
+    }
+    CV_Assert(options.rotationScaleCandidates >= 0);
+    double scoringScale = std::min(1.0, scoringDimension / (double)std::max(processingSize.width, processingSize.height));
+    auto scoringSize = cv::Size(std::max<int>(processingSize.width * scoringScale, 1), std::max<int>(processingSize.height * scoringScale, 1));
+    auto spectrumSize = getSpectrumSize(processingSize.width, processingSize.height, options);
+    return std::make_shared<const RegistrationPlan>(RegistrationPlan{
+        .cols=cols,
+        .rows=rows,
+        .processingSize=processingSize,
+        .pyramidLevels=options.pyramidLevels,
+        .refinementWindow=cv::Rect((cols - refinementSize.width) / 2, (rows - refinementSize.height) / 2, refinementSize.width, refinementSize.height),
+        .rotationScaleCandidates=options.rotationScaleCandidates,
+        .autoModeResponseThreshold=options.autoModeResponseThreshold,
+        .scoringSize=scoringSize,
+        .spectrumSize=spectrumSize,
+        .highPassFilter=getHighPassFilter(spectrumSize.height, spectrumSize.width),
+        .apodizationWindow=getApodizationWindow(processingSize.width, processingSize.height, std::min(processingSize.width, processingSize.height)),
+        .logPolarMap=createLogPolarMap(spectrumSize.width, spectrumSize.height, options.fixedPointLogPolarMap),
+    });
+}
+
+RegistrationBuffers& getThreadRegistrationBuffers() {
+    thread_local RegistrationBuffers buffers;
+    return buffers;
+}
+
+// `img` itself without pyramid levels, as the apodization and correlation
+// kernels convert it to grayscale on the fly. With pyramid levels it is
+// converted once here for the resize and the refinement window.
+static const cv::Mat& getRegistrationImage(const cv::Mat &img, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    if(plan.pyramidLevels == 0){
+        return img;
+    }
+    return convertToGrayscale(img, buffers.processing.grayBuffer);
+}
+
+// `img` downscaled to the processing size of `plan`, or `img` itself without pyramid levels
+static const cv::Mat& getPyramidImage(const cv::Mat &img, const RegistrationPlan& plan, cv::Mat& buffer) {
+    if(plan.pyramidLevels == 0){
+        return img;
+    }
+    cv::resize(img, buffer, plan.processingSize, 0.0, 0.0, cv::INTER_AREA);
+    return buffer;
+}
+
+bool needsPlanRegistration(const RegistrationPlan& plan) {
+    return plan.pyramidLevels > 0 || plan.rotationScaleCandidates > 0;
+}
+
+ReferenceSpectra getReferenceSpectra(const cv::Mat &img, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    const cv::Mat& gray = getRegistrationImage(img, plan, buffers);
+    const cv::Mat& coarse = getPyramidImage(gray, plan, buffers.pyramid);
+    auto reference = getReferenceSpectra(coarse, plan.highPassFilter, plan.apodizationWindow, plan.logPolarMap, buffers);
+    if(plan.pyramidLevels > 0){
+        getCorrelationSpectrum(gray(plan.refinementWindow), reference.refinementSpectrum, buffers.translationCorrelation);
+    }
+    if(plan.rotationScaleCandidates > 0){
+        cv::resize(coarse, buffers.scoring, plan.scoringSize, 0.0, 0.0, cv::INTER_AREA);
+        getCorrelationSpectrum(buffers.scoring, reference.scoringSpectrum, buffers.translationCorrelation);
+    }
+    return reference;
+}
+
+// Scales offsets registered at the processing size to full resolution and
+// refines them with pyramid levels
+static Transform refineTranslation(const cv::Mat &gray0, Transform transform, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    if(plan.pyramidLevels == 0){
+        return transform;
+    }
+
+    const double scaleX = plan.cols / (double)plan.processingSize.width;
+    const double scaleY = plan.rows / (double)plan.processingSize.height;
+    transform.SetOffsetX(transform.GetOffsetX() * scaleX);
+    transform.SetOffsetY(transform.GetOffsetY() * scaleY);
+    const int searchRadius = refinementSearchCoarseRadius << plan.pyramidLevels;
+    return refineTranslation(gray0, transform, plan.refinementWindow, reference1.refinementSpectrum, searchRadius, buffers);
+}
+
+// Registers the translation of the chosen rotation and scale at the processing
+// size, refined at full resolution with pyramid levels. The warp needs a gray
+// image, without pyramid levels `coarse0` is converted only here.
+static Transform registerTranslation(const cv::Mat &gray0, const cv::Mat &coarse0, double rotation, double scale, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    const cv::Mat& grayCoarse0 = convertToGrayscale(coarse0, buffers.processing.grayBuffer);
+    return refineTranslation(gray0, registerTranslation(grayCoarse0, rotation, scale, reference1.spectrum, buffers), reference1, plan, buffers);
+}
+
+// The registrations below take the image of `getRegistrationImage`
+
+static Transform registerTranslationOnly(const cv::Mat &gray0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    const cv::Mat& coarse0 = getPyramidImage(gray0, plan, buffers.pyramid);
+    Transform transform;
+    {
+        REGISTRATION_STAGE_TIMER(RegistrationStage::TranslationCorrelation, &buffers.spectrum);
+        getCorrelationSpectrum(coarse0, buffers.spectrum, buffers.translationCorrelation);
+
+        double response;
+        auto[xOffset, yOffset] = phaseCorrelateSpectrums(reference1.spectrum, buffers.spectrum, buffers.translationCorrelation, &response);
+        transform = Transform(-xOffset, yOffset, 1.0, 0.0, response);
+    }
+    return refineTranslation(gray0, transform, reference1, plan, buffers);
+}
+
+// Rotation and scale of the highest log-polar correlation peak only
+static Transform registerHighestPeak(const cv::Mat &gray0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    const cv::Mat& coarse0 = getPyramidImage(gray0, plan, buffers.pyramid);
+    getProcessedImage(coarse0, plan.highPassFilter, plan.apodizationWindow, plan.logPolarMap, buffers.processing);
+    double rotation, scale;
+    {
+        REGISTRATION_STAGE_TIMER(RegistrationStage::LogPolarCorrelation, &buffers.logPolarSpectrum);
+        getCorrelationSpectrum(buffers.processing.logPolar, buffers.logPolarSpectrum, buffers.logPolarCorrelation);
+        std::tie(rotation, scale) = getRotationScale(phaseCorrelateSpectrums(reference1.logPolarSpectrum, buffers.logPolarSpectrum, buffers.logPolarCorrelation), plan.logPolarMap);
+    }
+    return registerTranslation(gray0, coarse0, rotation, scale, reference1, plan, buffers);
+}
+
+static std::vector<Transform> registerCandidates(const cv::Mat &gray0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    CV_Assert(!reference1.scoringSpectrum.empty());
+
+    const cv::Mat& coarse0 = getPyramidImage(gray0, plan, buffers.pyramid);
+    getProcessedImage(coarse0, plan.highPassFilter, plan.apodizationWindow, plan.logPolarMap, buffers.processing);
+    std::vector<CorrelationPeak> peaks;
+    {
+        REGISTRATION_STAGE_TIMER(RegistrationStage::LogPolarCorrelation, &buffers.logPolarSpectrum);
+        getCorrelationSpectrum(buffers.processing.logPolar, buffers.logPolarSpectrum, buffers.logPolarCorrelation);
+        getCorrelationSurface(reference1.logPolarSpectrum, buffers.logPolarSpectrum, buffers.logPolarCorrelation);
+        peaks = findCorrelationPeaks(buffers.logPolarCorrelation.correlation, plan.rotationScaleCandidates);
+    }
+    if(peaks.empty()){
+        return {registerHighestPeak(gray0, reference1, plan, buffers)};
+    }
+
+    // The log-polar map only covers half of the angles, so every peak is also
+    // a rotation by 180 degrees
+    cv::resize(coarse0, buffers.scoring, plan.scoringSize, 0.0, 0.0, cv::INTER_AREA);
+    const double scaleX = plan.cols / (double)plan.scoringSize.width;
+    const double scaleY = plan.rows / (double)plan.scoringSize.height;
+    std::vector<Transform> candidates;
+    candidates.reserve(2 * peaks.size());
+    for(const auto& peak : peaks){
+        auto[rotation, scale] = getRotationScale(peak.shift, plan.logPolarMap);
+        for(double candidateRotation : {rotation, rotation > 0.0 ? rotation - 180.0 : rotation + 180.0}){
+            auto transform = registerTranslation(buffers.scoring, candidateRotation, scale, reference1.scoringSpectrum, buffers);
+            transform.SetOffsetX(transform.GetOffsetX() * scaleX);
+            transform.SetOffsetY(transform.GetOffsetY() * scaleY);
+            candidates.push_back(transform);
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Transform& a, const Transform& b){
+        return a.GetResponse() > b.GetResponse();
+    });
+
+    candidates.front() = registerTranslation(gray0, coarse0, candidates.front().GetRotation(), candidates.front().GetScale(), reference1, plan, buffers);
+    return candidates;
+}
+
+Transform registerGrayImageTranslation(const cv::Mat &img0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    return registerTranslationOnly(getRegistrationImage(img0, plan, buffers), reference1, plan, buffers);
+}
+
+Transform registerGrayImage(const cv::Mat &img0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers, RegistrationMode mode) {
+    const cv::Mat& gray0 = getRegistrationImage(img0, plan, buffers);
+    if(mode != RegistrationMode::Full){
+        auto transform = registerTranslationOnly(gray0, reference1, plan, buffers);
+        if(mode == RegistrationMode::TranslationOnly || transform.GetResponse() >= plan.autoModeResponseThreshold){
+            return transform;
+        }
+    }
+
+    if(plan.rotationScaleCandidates > 0){
+        return registerCandidates(gray0, reference1, plan, buffers).front();
+    }
+    return registerHighestPeak(gray0, reference1, plan, buffers);
+}
+
+std::vector<Transform> registerGrayImageCandidates(const cv::Mat &img0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    return registerCandidates(getRegistrationImage(img0, plan, buffers), reference1, plan, buffers);
+}
+
+const cv::Mat& getLogPolarSpectrum(const cv::Mat &img, const RegistrationPlan& plan, RegistrationBuffers& buffers) {
+    const cv::Mat& gray = getRegistrationImage(img, plan, buffers);
+    const cv::Mat& coarse = getPyramidImage(gray, plan, buffers.pyramid);
+    getProcessedImage(coarse, plan.highPassFilter, plan.apodizationWindow, plan.logPolarMap, buffers.processing);
+    REGISTRATION_STAGE_TIMER(RegistrationStage::LogPolarCorrelation, &buffers.logPolarSpectrum);
+    getCorrelationSpectrum(buffers.processing.logPolar, buffers.logPolarSpectrum, buffers.logPolarCorrelation);
+    return buffers.logPolarSpectrum;
+}
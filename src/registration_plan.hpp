@@ -0,0 +1,61 @@
+#ifndef __REGISTRATION_PLAN_H__
+#define __REGISTRATION_PLAN_H__
+
+#include <memory>
+
+#include "utilities.hpp"
+
+// Everything that only depends on the image size and options. A plan is never
+// modified after creation, so one plan can be shared by any number of
+// registration objects and threads.
+struct RegistrationPlan{
+    int cols;
+    int rows;
+    // Size at which rotation and scale are estimated, smaller than the image
+    // size with pyramid levels. Filters and the map are for this size.
+    cv::Size processingSize;
+    int pyramidLevels;
+    // Part of the full resolution image used to refine the translation
+    cv::Rect refinementWindow;
+    int rotationScaleCandidates;
+    double autoModeResponseThreshold;
+    // Size at which rotation and scale candidates are scored
+    cv::Size scoringSize;
+    cv::Size spectrumSize;
+    cv::Mat highPassFilter;
+    cv::Mat apodizationWindow;
+    LogPolarMap logPolarMap;
+    // Memory the matrices point into when loaded from a file
+    std::shared_ptr<const void> storage;
+};
+
+std::shared_ptr<const RegistrationPlan> createRegistrationPlan(int cols, int rows, const RegistrationOptions& options = {});
+
+// Scratch buffers of the calling thread. They grow to the largest plan used on
+// the thread and are reused by every registration on it.
+RegistrationBuffers& getThreadRegistrationBuffers();
+
+// Whether registration with `plan` needs the functions below, or is the plain
+// log-polar correlation of utilities.hpp
+bool needsPlanRegistration(const RegistrationPlan& plan);
+
+// Same as the functions in utilities.hpp, but using the pyramid levels and
+// rotation and scale candidates of `plan`. Images may also be BGR or BGRA, they
+// are converted to grayscale within the first pass over them.
+ReferenceSpectra getReferenceSpectra(const cv::Mat &img, const RegistrationPlan& plan, RegistrationBuffers& buffers);
+Transform registerGrayImage(const cv::Mat &img0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers, RegistrationMode mode = RegistrationMode::Full);
+
+// Translation of `img0` against the reference, without rotation and scale.
+// Takes a single correlation with the cached spectrum and no warp.
+Transform registerGrayImageTranslation(const cv::Mat &img0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers);
+
+// All scored rotation and scale candidates, best first. Only the best one has
+// its translation registered at full resolution, the others have the
+// translation and response of the scoring stage.
+std::vector<Transform> registerGrayImageCandidates(const cv::Mat &img0, const ReferenceSpectra& reference1, const RegistrationPlan& plan, RegistrationBuffers& buffers);
+
+// Spectrum of the log-polar image of `img` at the processing size, stored in
+// `buffers.logPolarSpectrum`. Equals the `logPolarSpectrum` of its reference spectrums.
+const cv::Mat& getLogPolarSpectrum(const cv::Mat &img, const RegistrationPlan& plan, RegistrationBuffers& buffers);
+
+#endif // __REGISTRATION_PLAN_H__
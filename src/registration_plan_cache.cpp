@@ -0,0 +1,370 @@
+#include "registration_plan_cache.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
+// Also tells apart files of a different byte order
+constexpr uint32_t planFileMagic = 0x4e4c5046; // "FPLN"
+constexpr uint32_t planFileVersion = 4;
+// Matrix data starts at multiples of this in the file, so that the mapped
+// matrices are as aligned as allocated ones
+constexpr size_t planFileAlignment = 64;
+
+struct PlanFileHeader{
+    uint32_t magic;
+    uint32_t version;
+    int32_t cols;
+    int32_t rows;
+    int32_t processingWidth;
+    int32_t processingHeight;
+    int32_t pyramidLevels;
+    int32_t refinementX;
+    int32_t refinementY;
+    int32_t refinementWidth;
+    int32_t refinementHeight;
+    int32_t rotationScaleCandidates;
+    int32_t scoringWidth;
+    int32_t scoringHeight;
+    int32_t spectrumWidth;
+    int32_t spectrumHeight;
+    int32_t logPolarSize;
+    int32_t padding;
+    double autoModeResponseThreshold;
+    double logBase;
+    // Size of the whole file, so that truncated files are not loaded
+    uint64_t fileSize;
+    // Of this header, with the checksum itself zero, and the matrix headers.
+    // Checked on every load, unlike the checksum of the matrix data which
+    // would read the whole mapping.
+    uint64_t headerChecksum;
+    uint64_t dataChecksum;
+};
+
+struct MatHeader{
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    int32_t padding;
+    uint64_t offset;
+};
+
+// Matrices in the order they are stored
+constexpr size_t planFileMatCount = 6;
+
+template <typename Plan>
+static std::array<decltype(&std::declval<Plan&>().highPassFilter), planFileMatCount> getPlanMats(Plan& plan) {
+    return {&plan.highPassFilter, &plan.apodizationWindow, &plan.logPolarMap.xMap, &plan.logPolarMap.yMap, &plan.logPolarMap.fixedMap, &plan.logPolarMap.fixedInterpolation};
+}
+
+static size_t alignOffset(size_t offset) {
+    return (offset + planFileAlignment - 1) / planFileAlignment * planFileAlignment;
+}
+
+constexpr uint64_t checksumSeed = 0xcbf29ce484222325ull;
+
+// 64-bit FNV-1a, continuing from `hash`
+static uint64_t getChecksum(const uchar* data, size_t size, uint64_t hash = checksumSeed) {
+    for(size_t i = 0; i < size; i++){
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t getHeaderChecksum(PlanFileHeader header, const std::array<MatHeader, planFileMatCount>& matHeaders) {
+    header.headerChecksum = 0;
+    uint64_t hash = getChecksum(reinterpret_cast<const uchar*>(&header), sizeof(header));
+    return getChecksum(reinterpret_cast<const uchar*>(matHeaders.data()), sizeof(matHeaders), hash);
+}
+
+// Read-only mapping of a whole file, unmapped with the last plan using it
+class MappedFile{
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            throw std::runtime_error("Cannot open plan file: " + path);
+        }
+        struct stat status;
+        if(fstat(fd, &status) != 0 || status.st_size == 0){
+            close(fd);
+            throw std::runtime_error("Cannot read plan file: " + path);
+        }
+        size_ = status.st_size;
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data_ == MAP_FAILED){
+            throw std::runtime_error("Cannot map plan file: " + path);
+        }
+    }
+    ~MappedFile() {
+        munmap(data_, size_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uchar* Data() const { return static_cast<const uchar*>(data_); }
+    size_t Size() const { return size_; }
+
+private:
+    void* data_;
+    size_t size_;
+};
+
+using PlanKey = std::tuple<int, int, bool, bool, int, int, double>;
+
+static PlanKey getPlanKey(int cols, int rows, const RegistrationOptions& options) {
+    return {cols, rows, options.padToOptimalDftSize, options.fixedPointLogPolarMap, options.pyramidLevels, options.rotationScaleCandidates, options.autoModeResponseThreshold};
+}
+
+static std::string getPlanFileName(int cols, int rows, const RegistrationOptions& options) {
+    std::ostringstream name;
+    name << "plan_" << cols << "x" << rows
+        << "_p" << options.padToOptimalDftSize
+        << "_f" << options.fixedPointLogPolarMap
+        << "_l" << options.pyramidLevels
+        << "_c" << options.rotationScaleCandidates
+        // Bit pattern of the threshold, so that different thresholds never share a file
+        << "_t" << std::hex << std::bit_cast<uint64_t>(options.autoModeResponseThreshold)
+        << ".bin";
+    return name.str();
+}
+
+// Whether `plan` is the one `createRegistrationPlan` makes for the key, so
+// that a file of another key is never used
+static bool isPlanOfKey(const RegistrationPlan& plan, int cols, int rows, const RegistrationOptions& options) {
+    return plan.cols == cols
+        && plan.rows == rows
+        && plan.pyramidLevels == options.pyramidLevels
+        && plan.rotationScaleCandidates == options.rotationScaleCandidates
+        && std::bit_cast<uint64_t>(plan.autoModeResponseThreshold) == std::bit_cast<uint64_t>(options.autoModeResponseThreshold)
+        && plan.logPolarMap.fixedMap.empty() != options.fixedPointLogPolarMap
+        && plan.spectrumSize == getSpectrumSize(plan.processingSize.width, plan.processingSize.height, options);
+}
+
+struct PlanCache{
+    std::mutex mutex;
+    std::string directory;
+    std::map<PlanKey, std::shared_ptr<const RegistrationPlan>> plans;
+};
+
+static PlanCache& getPlanCache() {
+    static PlanCache cache;
+    return cache;
+}
+
+// Plan from the cache directory, or a new one which is then saved there
+static std::shared_ptr<const RegistrationPlan> loadOrCreateRegistrationPlan(int cols, int rows, const RegistrationOptions& options, const std::string& directory) {
+    if(directory.empty()){
+        return createRegistrationPlan(cols, rows, options);
+    }
+
+    const auto path = std::filesystem::path(directory) / getPlanFileName(cols, rows, options);
+    if(std::filesystem::exists(path)){
+        try{
+            auto plan = loadRegistrationPlan(path.string());
+            if(isPlanOfKey(*plan, cols, rows, options)){
+                return plan;
+            }
+            std::cerr << "Recreating registration plan: " << path.string() << " is for other options\n";
+        }
+        catch(const std::exception& e){
+            std::cerr << "Recreating registration plan: " << e.what() << "\n";
+        }
+    }
+
+    auto plan = createRegistrationPlan(cols, rows, options);
+    // Renaming is atomic, so other processes never load a partial file.
+    // Every writer has its own temporary file, also threads of one process
+    // racing to create the same plan.
+    static std::atomic<uint64_t> temporaryCount = 0;
+    auto temporary = path;
+    temporary += "." + std::to_string(getpid()) + "." + std::to_string(temporaryCount++) + ".tmp";
+    try{
+        std::filesystem::create_directories(directory);
+        saveRegistrationPlan(*plan, temporary.string());
+        std::filesystem::rename(temporary, path);
+    }
+    catch(const std::exception& e){
+        std::cerr << "Cannot save registration plan: " << e.what() << "\n";
+        std::error_code error;
+        std::filesystem::remove(temporary, error);
+    }
+    return plan;
+}
+
+std::shared_ptr<const RegistrationPlan> getRegistrationPlan(int cols, int rows, const RegistrationOptions& options) {
+    auto& cache = getPlanCache();
+    const auto key = getPlanKey(cols, rows, options);
+
+    std::string directory;
+    {
+        std::lock_guard lock(cache.mutex);
+        if(auto it = cache.plans.find(key); it != cache.plans.end()){
+            return it->second;
+        }
+        directory = cache.directory;
+    }
+
+    // Created without the lock, so plans of other sizes are not held up. If
+    // two threads race here, both get the plan inserted first.
+    auto plan = loadOrCreateRegistrationPlan(cols, rows, options, directory);
+    std::lock_guard lock(cache.mutex);
+    return cache.plans.try_emplace(key, std::move(plan)).first->second;
+}
+
+void setRegistrationPlanCacheDirectory(const std::string& directory) {
+    auto& cache = getPlanCache();
+    std::lock_guard lock(cache.mutex);
+    cache.directory = directory;
+}
+
+void clearRegistrationPlanCache() {
+    auto& cache = getPlanCache();
+    std::lock_guard lock(cache.mutex);
+    cache.plans.clear();
+}
+
+void saveRegistrationPlan(const RegistrationPlan& plan, const std::string& path) {
+    PlanFileHeader header{
+        .magic=planFileMagic,
+        .version=planFileVersion,
+        .cols=plan.cols,
+        .rows=plan.rows,
+        .processingWidth=plan.processingSize.width,
+        .processingHeight=plan.processingSize.height,
+        .pyramidLevels=plan.pyramidLevels,
+        .refinementX=plan.refinementWindow.x,
+        .refinementY=plan.refinementWindow.y,
+        .refinementWidth=plan.refinementWindow.width,
+        .refinementHeight=plan.refinementWindow.height,
+        .rotationScaleCandidates=plan.rotationScaleCandidates,
+        .scoringWidth=plan.scoringSize.width,
+        .scoringHeight=plan.scoringSize.height,
+        .spectrumWidth=plan.spectrumSize.width,
+        .spectrumHeight=plan.spectrumSize.height,
+        .logPolarSize=plan.logPolarMap.logPolarSize,
+        .padding=0,
+        .autoModeResponseThreshold=plan.autoModeResponseThreshold,
+        .logBase=plan.logPolarMap.logBase,
+        .fileSize=0,
+        .headerChecksum=0,
+        .dataChecksum=checksumSeed,
+    };
+
+    // Continuous copies, the plan may have been loaded with views
+    auto mats = getPlanMats(plan);
+    std::array<cv::Mat, planFileMatCount> continuous;
+    std::array<MatHeader, planFileMatCount> matHeaders;
+    size_t offset = alignOffset(sizeof(header) + sizeof(matHeaders));
+    for(size_t i = 0; i < planFileMatCount; i++){
+        continuous[i] = mats[i]->isContinuous() ? *mats[i] : mats[i]->clone();
+        matHeaders[i] = MatHeader{
+            .rows=continuous[i].rows,
+            .cols=continuous[i].cols,
+            .type=continuous[i].type(),
+            .padding=0,
+            .offset=offset,
+        };
+        offset = alignOffset(offset + continuous[i].total() * continuous[i].elemSize());
+    }
+
+    header.fileSize = sizeof(header) + sizeof(matHeaders);
+    for(size_t i = 0; i < planFileMatCount; i++){
+        const size_t size = continuous[i].total() * continuous[i].elemSize();
+        if(size > 0){
+            header.fileSize = std::max<uint64_t>(header.fileSize, matHeaders[i].offset + size);
+            header.dataChecksum = getChecksum(continuous[i].data, size, header.dataChecksum);
+        }
+    }
+    header.headerChecksum = getHeaderChecksum(header, matHeaders);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if(!file){
+        throw std::runtime_error("Cannot write plan file: " + path);
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(matHeaders.data()), sizeof(matHeaders));
+    for(size_t i = 0; i < planFileMatCount; i++){
+        file.seekp(matHeaders[i].offset);
+        file.write(reinterpret_cast<const char*>(continuous[i].data), continuous[i].total() * continuous[i].elemSize());
+    }
+    if(!file){
+        throw std::runtime_error("Cannot write plan file: " + path);
+    }
+}
+
+std::shared_ptr<const RegistrationPlan> loadRegistrationPlan(const std::string& path, bool verifyData) {
+    auto mapping = std::make_shared<const MappedFile>(path);
+
+    PlanFileHeader header;
+    std::array<MatHeader, planFileMatCount> matHeaders;
+    if(mapping->Size() < sizeof(header) + sizeof(matHeaders)){
+        throw std::runtime_error("Truncated plan file: " + path);
+    }
+    std::memcpy(&header, mapping->Data(), sizeof(header));
+    std::memcpy(matHeaders.data(), mapping->Data() + sizeof(header), sizeof(matHeaders));
+    if(header.magic != planFileMagic || header.version != planFileVersion){
+        throw std::runtime_error("Not a plan file of this version: " + path);
+    }
+    if(header.fileSize != mapping->Size()){
+        throw std::runtime_error("Truncated plan file: " + path);
+    }
+    if(header.headerChecksum != getHeaderChecksum(header, matHeaders)){
+        throw std::runtime_error("Corrupt plan file: " + path);
+    }
+    uint64_t dataChecksum = checksumSeed;
+
+    RegistrationPlan plan{
+        .cols=header.cols,
+        .rows=header.rows,
+        .processingSize=cv::Size(header.processingWidth, header.processingHeight),
+        .pyramidLevels=header.pyramidLevels,
+        .refinementWindow=cv::Rect(header.refinementX, header.refinementY, header.refinementWidth, header.refinementHeight),
+        .rotationScaleCandidates=header.rotationScaleCandidates,
+        .autoModeResponseThreshold=header.autoModeResponseThreshold,
+        .scoringSize=cv::Size(header.scoringWidth, header.scoringHeight),
+        .spectrumSize=cv::Size(header.spectrumWidth, header.spectrumHeight),
+        .logPolarMap=LogPolarMap{
+            .logPolarSize=header.logPolarSize,
+            .logBase=header.logBase,
+        },
+        .storage=mapping,
+    };
+
+    auto mats = getPlanMats(plan);
+    for(size_t i = 0; i < planFileMatCount; i++){
+        const auto& m = matHeaders[i];
+        if(m.rows == 0 || m.cols == 0){
+            continue;
+        }
+        const size_t size = (size_t)m.rows * m.cols * CV_ELEM_SIZE(m.type);
+        if(m.rows < 0 || m.cols < 0 || m.offset % planFileAlignment != 0 || m.offset + size > mapping->Size()){
+            throw std::runtime_error("Corrupt plan file: " + path);
+        }
+        if(verifyData){
+            dataChecksum = getChecksum(mapping->Data() + m.offset, size, dataChecksum);
+        }
+        // The plan is never modified, so the read-only mapping is never written
+        *mats[i] = cv::Mat(m.rows, m.cols, m.type, const_cast<uchar*>(mapping->Data() + m.offset));
+    }
+    if(verifyData && dataChecksum != header.dataChecksum){
+        throw std::runtime_error("Corrupt plan file: " + path);
+    }
+    return std::make_shared<const RegistrationPlan>(std::move(plan));
+}
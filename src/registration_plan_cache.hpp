@@ -0,0 +1,31 @@
+#ifndef __REGISTRATION_PLAN_CACHE_H__
+#define __REGISTRATION_PLAN_CACHE_H__
+
+#include <memory>
+#include <string>
+
+#include "registration_plan.hpp"
+
+// Plan for `cols` x `rows` and `options` from a process-wide cache. The plan
+// is created on first use and then shared by every later caller. Safe to call
+// from any thread.
+std::shared_ptr<const RegistrationPlan> getRegistrationPlan(int cols, int rows, const RegistrationOptions& options = {});
+
+// Directory where the cache also keeps plans as files. Plans missing from
+// memory are loaded from there before being created, and created plans are
+// saved there. Empty, the default, keeps plans in memory only.
+void setRegistrationPlanCacheDirectory(const std::string& directory);
+
+// Drops the plans from memory. Instances keep the plans they already have.
+void clearRegistrationPlanCache();
+
+// Compact binary file of `plan`, only meant to be read on the same machine
+void saveRegistrationPlan(const RegistrationPlan& plan, const std::string& path);
+
+// Plan saved with `saveRegistrationPlan`. The file is memory-mapped and the
+// matrices of the plan point into the mapping, so only the headers are read
+// up front. `verifyData` also checks the checksum of the matrices, which reads
+// the whole file.
+std::shared_ptr<const RegistrationPlan> loadRegistrationPlan(const std::string& path, bool verifyData = false);
+
+#endif // __REGISTRATION_PLAN_CACHE_H__
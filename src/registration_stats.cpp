@@ -0,0 +1,83 @@
+#include "registration_stats.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+std::string getRegistrationStageName(RegistrationStage stage) {
+    switch(stage){
+        case RegistrationStage::Grayscale: return "grayscale";
+        case RegistrationStage::Apodization: return "apodization";
+        case RegistrationStage::FFT: return "fft";
+        case RegistrationStage::Filter: return "filter";
+        case RegistrationStage::LogPolarRemap: return "log_polar_remap";
+        case RegistrationStage::LogPolarCorrelation: return "log_polar_correlation";
+        case RegistrationStage::TranslationCorrelation: return "translation_correlation";
+        case RegistrationStage::Warp: return "warp";
+        default: throw std::runtime_error("Unknown registration stage.");
+    }
+}
+
+#ifdef FOURIER_MELLIN_STATS
+void RegistrationStats::Record(RegistrationStage stage, std::chrono::steady_clock::duration duration, bool allocated) {
+    auto& s = stages_[static_cast<size_t>(stage)];
+    const uint64_t call = s.calls.fetch_add(1, std::memory_order_relaxed);
+    s.recent[call % window].store(duration.count(), std::memory_order_relaxed);
+    s.total.fetch_add(duration.count(), std::memory_order_relaxed);
+    if(allocated){
+        s.allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static double toMilliseconds(std::chrono::steady_clock::rep ticks) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::duration(ticks)).count();
+}
+
+std::vector<StageStats> RegistrationStats::Get() const {
+    std::vector<StageStats> result;
+    result.reserve(stages_.size());
+
+    for(size_t i = 0; i < stages_.size(); i++){
+        const auto& s = stages_[i];
+        const uint64_t calls = s.calls.load(std::memory_order_relaxed);
+        StageStats stats{
+            .stage=getRegistrationStageName(static_cast<RegistrationStage>(i)),
+            .calls=calls,
+            .allocations=s.allocations.load(std::memory_order_relaxed),
+            .totalMilliseconds=toMilliseconds(s.total.load(std::memory_order_relaxed)),
+        };
+        if(calls > 0){
+            const size_t count = std::min<uint64_t>(calls, window);
+            std::array<Ticks, window> recent;
+            for(size_t j = 0; j < count; j++){
+                recent[j] = s.recent[j].load(std::memory_order_relaxed);
+            }
+            std::sort(recent.begin(), recent.begin() + count);
+            auto percentile = [&](double p){ return toMilliseconds(recent[static_cast<size_t>(p * (count - 1) + 0.5)]); };
+            stats.p50Milliseconds = percentile(0.5);
+            stats.p90Milliseconds = percentile(0.9);
+            stats.p99Milliseconds = percentile(0.99);
+        }
+        result.push_back(std::move(stats));
+    }
+    return result;
+}
+
+void RegistrationStats::Reset() {
+    for(auto& s : stages_){
+        s.calls.store(0, std::memory_order_relaxed);
+        s.allocations.store(0, std::memory_order_relaxed);
+        s.total.store(0, std::memory_order_relaxed);
+        for(auto& ticks : s.recent){
+            ticks.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+#else
+std::vector<StageStats> RegistrationStats::Get() const {
+    std::vector<StageStats> result;
+    for(size_t i = 0; i < static_cast<size_t>(RegistrationStage::Count); i++){
+        result.push_back(StageStats{.stage=getRegistrationStageName(static_cast<RegistrationStage>(i))});
+    }
+    return result;
+}
+#endif
@@ -0,0 +1,149 @@
+#ifndef __REGISTRATION_STATS_H__
+#define __REGISTRATION_STATS_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#ifdef FOURIER_MELLIN_STATS
+constexpr bool registrationStatsEnabled = true;
+#else
+constexpr bool registrationStatsEnabled = false;
+#endif
+
+enum class RegistrationStage{
+    Grayscale,
+    Apodization,
+    FFT,
+    Filter,
+    LogPolarRemap,
+    LogPolarCorrelation,
+    TranslationCorrelation,
+    Warp,
+    Count
+};
+
+std::string getRegistrationStageName(RegistrationStage stage);
+
+struct StageStats{
+    std::string stage;
+    uint64_t calls = 0;
+    // Calls that allocated their output instead of reusing a buffer
+    uint64_t allocations = 0;
+    double totalMilliseconds = 0.0;
+    // Over the last `RegistrationStats::window` calls
+    double p50Milliseconds = 0.0;
+    double p90Milliseconds = 0.0;
+    double p99Milliseconds = 0.0;
+};
+
+// Timings of the registration stages of one registration object. Stages
+// record into the statistics of the object whose method is running on the
+// current thread, see `RegistrationStatsScope`. Without FOURIER_MELLIN_STATS
+// this is an empty type that records nothing, held with [[no_unique_address]].
+#ifdef FOURIER_MELLIN_STATS
+class RegistrationStats{
+public:
+    static constexpr size_t window = 256;
+
+    // Lock-free, so threads registering with the same object do not wait on
+    // each other
+    void Record(RegistrationStage stage, std::chrono::steady_clock::duration duration, bool allocated);
+    // One entry per stage, in the order of `RegistrationStage`. Calls
+    // recorded meanwhile may be partly included.
+    std::vector<StageStats> Get() const;
+    void Reset();
+
+private:
+    using Ticks = std::chrono::steady_clock::rep;
+
+    struct Stage{
+        std::atomic<uint64_t> calls = 0;
+        std::atomic<uint64_t> allocations = 0;
+        std::atomic<Ticks> total = 0;
+        // Ring buffer indexed by `calls`
+        std::array<std::atomic<Ticks>, window> recent{};
+    };
+
+    std::array<Stage, static_cast<size_t>(RegistrationStage::Count)> stages_;
+};
+#else
+class RegistrationStats{
+public:
+    void Record(RegistrationStage, std::chrono::steady_clock::duration, bool) {}
+    // One entry per stage, all zero
+    std::vector<StageStats> Get() const;
+    void Reset() {}
+};
+static_assert(std::is_empty_v<RegistrationStats>);
+#endif
+
+// Statistics that stages on this thread record into, or null
+inline RegistrationStats*& currentRegistrationStats() {
+    thread_local RegistrationStats* stats = nullptr;
+    return stats;
+}
+
+// Makes stages on this thread record into `stats` until destroyed
+class RegistrationStatsScope{
+public:
+    explicit RegistrationStatsScope(RegistrationStats& stats):
+        previous_(std::exchange(currentRegistrationStats(), &stats))
+    {
+    }
+    ~RegistrationStatsScope() {
+        currentRegistrationStats() = previous_;
+    }
+    RegistrationStatsScope(const RegistrationStatsScope&) = delete;
+    RegistrationStatsScope& operator=(const RegistrationStatsScope&) = delete;
+
+private:
+    RegistrationStats* previous_;
+};
+
+// Times its own lifetime as `stage`. A new data pointer in `output` counts as
+// an allocation.
+class StageTimer{
+public:
+    explicit StageTimer(RegistrationStage stage, const cv::Mat* output = nullptr):
+        stats_(currentRegistrationStats()),
+        stage_(stage),
+        output_(output),
+        data_(output ? output->data : nullptr)
+    {
+        if(stats_){
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~StageTimer() {
+        if(stats_){
+            stats_->Record(stage_, std::chrono::steady_clock::now() - start_, output_ && output_->data != data_);
+        }
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    RegistrationStats* stats_;
+    RegistrationStage stage_;
+    const cv::Mat* output_;
+    const uchar* data_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#ifdef FOURIER_MELLIN_STATS
+#define REGISTRATION_STATS_SCOPE(stats) RegistrationStatsScope registrationStatsScope(stats)
+#define REGISTRATION_STAGE_TIMER(...) StageTimer stageTimer(__VA_ARGS__)
+#else
+#define REGISTRATION_STATS_SCOPE(stats)
+#define REGISTRATION_STAGE_TIMER(...)
+#endif
+
+#endif // __REGISTRATION_STATS_H__
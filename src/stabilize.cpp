@@ -0,0 +1,69 @@
+#include "video_stabilization.hpp"
+
+#include <chrono>
+#include <iostream>
+
+void printUsage(const char* program){
+    std::cerr << "Usage: " << program << " <input> <output> [options]\n"
+        << "  --edge-crop <ratio>          Cropped from every edge (default 0.1)\n"
+        << "  --pull-to-center <ratio>     Drift correction per frame (default 0.07)\n"
+        << "  --queue-depth <frames>       Frames between pipeline stages (default 8)\n"
+        << "  --pyramid-levels <levels>    Estimate rotation and scale at a lower resolution (default 0)\n"
+        << "  --keyframe-response <min>    Register against keyframes, new one below this response (default off)\n"
+        << "  --fourcc <code>              Codec of the output (default mp4v)\n";
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    StabilizationOptions options;
+    for(int i=3; i<argc; i++){
+        std::string option = argv[i];
+        if(i + 1 >= argc){
+            std::cerr << "Missing value for " << option << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if(option == "--edge-crop"){
+            options.edgeCrop = std::stod(value);
+        }
+        else if(option == "--pull-to-center"){
+            options.pullToCenterRatio = std::stod(value);
+        }
+        else if(option == "--queue-depth"){
+            options.queueDepth = std::stoul(value);
+        }
+        else if(option == "--pyramid-levels"){
+            options.registration.pyramidLevels = std::stoi(value);
+        }
+        else if(option == "--keyframe-response"){
+            options.keyframes.enabled = true;
+            options.keyframes.minResponse = std::stod(value);
+        }
+        else if(option == "--fourcc"){
+            options.fourcc = value;
+        }
+        else{
+            std::cerr << "Unknown option " << option << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    try{
+        auto startTime = std::chrono::high_resolution_clock::now();
+        auto transforms = StabilizeVideo(argv[1], argv[2], options);
+        auto seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+        std::cout << "Stabilized " << transforms.size() << " frames in " << seconds << " s ("
+            << transforms.size() / seconds << " fps)\n";
+    }
+    catch(const std::exception& e){
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount):
+    stopping_(false)
+{
+    if(threadCount == 0){
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(threadCount - 1);
+    for(unsigned i=1; i<threadCount; i++){
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for(auto& worker : workers_){
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::GetThreadCount() const {
+    return workers_.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& function) {
+    auto job = std::make_shared<Job>();
+    job->function = &function;
+    job->count = count;
+    job->next = 0;
+    job->finished = 0;
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.push_back(job);
+    }
+    wake_.notify_all();
+    RunJob(job);
+
+    // Workers may still run the last indices they took
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [&]{ return job->finished == job->count; });
+    if(job->exception){
+        std::rethrow_exception(job->exception);
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    while(true){
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [this]{ return stopping_ || !jobs_.empty(); });
+            if(stopping_){
+                return;
+            }
+            job = jobs_.front();
+        }
+        RunJob(job);
+    }
+}
+
+void ThreadPool::RunJob(const std::shared_ptr<Job>& job) {
+    size_t finished = 0;
+    std::exception_ptr exception;
+    for(size_t i = job->next++; i < job->count; i = job->next++){
+        try{
+            (*job->function)(i);
+        }
+        catch(...){
+            if(!exception){
+                exception = std::current_exception();
+            }
+        }
+        finished++;
+    }
+
+    std::lock_guard lock(mutex_);
+    // All indices are taken, so no thread needs to find the job anymore
+    std::erase(jobs_, job);
+    if(exception && !job->exception){
+        job->exception = exception;
+    }
+    job->finished += finished;
+    if(job->finished == job->count){
+        done_.notify_all();
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel loops. Workers live as long
+// as the pool, so their thread-local registration buffers are reused between
+// batches.
+class ThreadPool{
+public:
+    // `threadCount` includes the calling thread, 0 uses all hardware threads
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned GetThreadCount() const;
+
+    // Calls `function(i)` for every i in [0, count) and returns once all calls
+    // are done. The calling thread takes part. An exception thrown by
+    // `function` is rethrown after the loop. Concurrent calls are queued and
+    // share the workers, each caller working on its own loop.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& function);
+
+private:
+    // One call of `ParallelFor`
+    struct Job{
+        const std::function<void(size_t)>* function;
+        size_t count;
+        std::atomic<size_t> next;
+        // Guarded by `mutex_`
+        size_t finished;
+        std::exception_ptr exception;
+    };
+
+    void WorkerLoop();
+    // Runs indices of `job` until none are left, then removes it from the queue
+    void RunJob(const std::shared_ptr<Job>& job);
+
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bool stopping_;
+    // Jobs that may still have indices left, oldest first
+    std::deque<std::shared_ptr<Job>> jobs_;
+};
+
+#endif // __THREAD_POOL_H__
@@ -7,42 +7,48 @@ Transform::Transform(double xOffset, double yOffset, double scale, double rotati
     yOffset_(yOffset),
     scale_(scale),
     rotation_(rotationDeg),
-    response_(response)
+    response_(response),
+    cos_(std::cos(rotationDeg * (std::numbers::pi_v<double>/180.0))),
+    sin_(std::sin(rotationDeg * (std::numbers::pi_v<double>/180.0)))
 {
 }
 
-Transform::Transform(const cv::Mat& matrix, double response){
+static cv::Matx33d toMatx33d(const cv::Mat& matrix) {
     CV_Assert(matrix.rows == 3 && matrix.cols == 3);
-
-    xOffset_ = matrix.at<double>(0, 2);
-    yOffset_ = matrix.at<double>(1, 2);
-
-    scale_ = std::hypot(matrix.at<double>(0, 0), matrix.at<double>(0, 1));
-    rotation_ = std::atan2(matrix.at<double>(1, 0), matrix.at<double>(0, 0)) * (180.0/std::numbers::pi_v<double>);
-    response_ = response;
+    return matrix;
 }
 
-cv::Mat Transform::GetMatrix() const {
-    cv::Mat transform = cv::Mat::zeros(3, 3, CV_64F);
+Transform::Transform(const cv::Mat& matrix, double response):
+    Transform(toMatx33d(matrix), response)
+{
+}
 
-    double c = std::cos(rotation_ * (std::numbers::pi_v<double>/180.0));
-    double s = std::sin(rotation_ * (std::numbers::pi_v<double>/180.0));
+Transform::Transform(const cv::Matx33d& matrix, double response):
+    Transform(Similarity{
+        .a=matrix(0, 0),
+        .b=matrix(1, 0),
+        .x=matrix(0, 2),
+        .y=matrix(1, 2),
+    }, response)
+{
+}
 
-    transform.at<double>(0, 0) = scale_ * c;
-    transform.at<double>(0, 1) = -scale_ * s;
-    transform.at<double>(0, 2) = xOffset_;
-    transform.at<double>(1, 0) = scale_ * s;
-    transform.at<double>(1, 1) = scale_ * c;
-    transform.at<double>(1, 2) = yOffset_;
-    transform.at<double>(2, 0) = 0.0;
-    transform.at<double>(2, 1) = 0.0;
-    transform.at<double>(2, 2) = 1.0;
+cv::Matx33d Transform::GetMatx() const {
+    const double a = scale_ * cos_;
+    const double b = scale_ * sin_;
+    return cv::Matx33d(
+        a, -b, xOffset_,
+        b, a, yOffset_,
+        0.0, 0.0, 1.0
+    );
+}
 
-    return transform;
+cv::Mat Transform::GetMatrix() const {
+    return cv::Mat(GetMatx(), true);
 }
 
 cv::Mat Transform::GetMatrixInverse() const {
-    return GetMatrix().inv();
+    return GetInverse().GetMatrix();
 }
 
 double Transform::GetOffsetX() const {
@@ -65,12 +71,6 @@ double Transform::GetResponse() const {
     return response_;
 }
 
-Transform Transform::operator*(const Transform& rhs) const {
-    // double response = (response_ + rhs.response_) * 0.5;
-    double response = std::min(response_, rhs.response_);
-    return Transform(GetMatrix() * rhs.GetMatrix(), response);
-}
-
 std::ostream& operator<<(std::ostream& os, const Transform& t){
     os << std::fixed << std::setprecision(2) << "Transform(" << t.GetOffsetX() << ", " << t.GetOffsetY() << ", " << t.GetScale() << ", " << t.GetRotation() << ", " << t.GetResponse() << ")";
     return os;
@@ -90,17 +90,11 @@ void Transform::SetScale(double scale) {
 
 void Transform::SetRotation(double rotationDeg) {
     rotation_ = rotationDeg;
+    cos_ = std::cos(rotationDeg * (std::numbers::pi_v<double>/180.0));
+    sin_ = std::sin(rotationDeg * (std::numbers::pi_v<double>/180.0));
 }
 
 void Transform::SetResponse(double response) {
     response_ = response;
 }
 
-Transform& Transform::operator*=(const Transform& rhs){
-    *this = *this * rhs;
-    return *this;
-}
-
-Transform Transform::GetInverse() const {
-    return Transform(GetMatrixInverse(), response_);
-}
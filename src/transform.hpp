@@ -1,20 +1,29 @@
 #ifndef __TRANSFORM_H__
 #define __TRANSFORM_H__
 
+#include <algorithm>
+#include <cmath>
+#include <numbers>
 #include <ostream>
 #include <opencv2/opencv.hpp>
 
+// Similarity transform. Keeps the cosine and sine of the rotation next to the
+// angle, so composing and inverting needs neither trigonometry nor matrices.
 class Transform{
 public:
     Transform(double xOffset=0.0, double yOffset=0.0, double scale=1.0, double rotationDeg=0.0, double response=1.0);
 
     // TODO: This assumes `matrix` is properly defined 2D transformation matrix
     Transform(const cv::Mat& matrix, double response);
+    Transform(const cv::Matx33d& matrix, double response);
 
+    // Closed form inverse of the similarity
     Transform GetInverse() const;
 
     cv::Mat GetMatrixInverse() const;
     cv::Mat GetMatrix() const;
+    // Same as GetMatrix, without allocating
+    cv::Matx33d GetMatx() const;
 
     void SetOffsetX(double x);
     void SetOffsetY(double y);
@@ -32,13 +41,71 @@ public:
     Transform& operator*=(const Transform& rhs);
 
 private:
+    // Upper rows of the matrix [a -b x; b a y; 0 0 1]
+    struct Similarity{
+        double a;
+        double b;
+        double x;
+        double y;
+    };
+
+    Transform(const Similarity& similarity, double response);
+
     double xOffset_;
     double yOffset_;
     double scale_;
     double rotation_;
     double response_;
+    // Of `rotation_`
+    double cos_;
+    double sin_;
 };
 
+// Composition and inversion are inline, they run for every frame and every
+// step of a trajectory
+
+inline Transform::Transform(const Similarity& similarity, double response):
+    xOffset_(similarity.x),
+    yOffset_(similarity.y),
+    scale_(std::hypot(similarity.a, similarity.b)),
+    rotation_(std::atan2(similarity.b, similarity.a) * (180.0/std::numbers::pi_v<double>)),
+    response_(response),
+    cos_(scale_ > 0.0 ? similarity.a / scale_ : 1.0),
+    sin_(scale_ > 0.0 ? similarity.b / scale_ : 0.0)
+{
+}
+
+inline Transform Transform::operator*(const Transform& rhs) const {
+    const double a = scale_ * cos_;
+    const double b = scale_ * sin_;
+    const double rhsA = rhs.scale_ * rhs.cos_;
+    const double rhsB = rhs.scale_ * rhs.sin_;
+    // double response = (response_ + rhs.response_) * 0.5;
+    double response = std::min(response_, rhs.response_);
+    return Transform(Similarity{
+        .a=a * rhsA - b * rhsB,
+        .b=b * rhsA + a * rhsB,
+        .x=a * rhs.xOffset_ - b * rhs.yOffset_ + xOffset_,
+        .y=b * rhs.xOffset_ + a * rhs.yOffset_ + yOffset_,
+    }, response);
+}
+
+inline Transform& Transform::operator*=(const Transform& rhs){
+    *this = *this * rhs;
+    return *this;
+}
+
+inline Transform Transform::GetInverse() const {
+    // Rotation and scale invert separately, the offset is rotated and scaled back
+    Transform inverse = *this;
+    inverse.scale_ = 1.0 / scale_;
+    inverse.rotation_ = -rotation_;
+    inverse.sin_ = -sin_;
+    inverse.xOffset_ = -(cos_ * xOffset_ + sin_ * yOffset_) / scale_;
+    inverse.yOffset_ = (sin_ * xOffset_ - cos_ * yOffset_) / scale_;
+    return inverse;
+}
+
 std::ostream& operator<<(std::ostream& os, const Transform& t);
 
-#endif // __TRANSFORM_H__
\ No newline at end of file
+#endif // __TRANSFORM_H__
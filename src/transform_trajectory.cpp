@@ -0,0 +1,247 @@
+#include "transform_trajectory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+
+constexpr double degreesToRadians = std::numbers::pi_v<double> / 180.0;
+constexpr double radiansToDegrees = 180.0 / std::numbers::pi_v<double>;
+
+TransformTrajectory::TransformTrajectory(size_t size):
+    xOffsets_(size, 0.0),
+    yOffsets_(size, 0.0),
+    scales_(size, 1.0),
+    rotations_(size, 0.0),
+    responses_(size, 1.0)
+{
+}
+
+TransformTrajectory::TransformTrajectory(std::span<const Transform> transforms):
+    TransformTrajectory(transforms.size())
+{
+    for(size_t i = 0; i < transforms.size(); i++){
+        Set(i, transforms[i]);
+    }
+}
+
+size_t TransformTrajectory::Size() const {
+    return xOffsets_.size();
+}
+
+void TransformTrajectory::PushBack(const Transform& transform) {
+    xOffsets_.push_back(transform.GetOffsetX());
+    yOffsets_.push_back(transform.GetOffsetY());
+    scales_.push_back(transform.GetScale());
+    rotations_.push_back(transform.GetRotation());
+    responses_.push_back(transform.GetResponse());
+}
+
+Transform TransformTrajectory::Get(size_t i) const {
+    return Transform(xOffsets_.at(i), yOffsets_[i], scales_[i], rotations_[i], responses_[i]);
+}
+
+void TransformTrajectory::Set(size_t i, const Transform& transform) {
+    xOffsets_.at(i) = transform.GetOffsetX();
+    yOffsets_[i] = transform.GetOffsetY();
+    scales_[i] = transform.GetScale();
+    rotations_[i] = transform.GetRotation();
+    responses_[i] = transform.GetResponse();
+}
+
+std::vector<Transform> TransformTrajectory::GetTransforms() const {
+    std::vector<Transform> transforms;
+    transforms.reserve(Size());
+    for(size_t i = 0; i < Size(); i++){
+        transforms.push_back(Get(i));
+    }
+    return transforms;
+}
+
+// Scales and rotations as the components of the matrices [a -b; b a], with
+// a = scale * cos(rotation) and b = scale * sin(rotation). A separate pass
+// without dependencies between the elements, so the compositions below loop
+// over multiplications and additions only.
+static void getRotationComponents(std::span<const double> scales, std::span<const double> rotations, std::vector<double>& a, std::vector<double>& b) {
+    const size_t n = scales.size();
+    a.resize(n);
+    b.resize(n);
+    for(size_t i = 0; i < n; i++){
+        const double angle = rotations[i] * degreesToRadians;
+        a[i] = scales[i] * std::cos(angle);
+        b[i] = scales[i] * std::sin(angle);
+    }
+}
+
+// Inverse of `getRotationComponents`, rotations in (-180, 180]
+static void getScalesRotations(const std::vector<double>& a, const std::vector<double>& b, std::span<double> scales, std::span<double> rotations) {
+    for(size_t i = 0; i < a.size(); i++){
+        scales[i] = std::hypot(a[i], b[i]);
+        rotations[i] = std::atan2(b[i], a[i]) * radiansToDegrees;
+    }
+}
+
+TransformTrajectory TransformTrajectory::GetCumulative() const {
+    const size_t n = Size();
+    TransformTrajectory result(n);
+    if(n == 0){
+        return result;
+    }
+
+    std::vector<double> a, b;
+    getRotationComponents(scales_, rotations_, a, b);
+    // Running product as the matrix [a -b x; b a y], written back to the components
+    double productA = 1.0, productB = 0.0, x = 0.0, y = 0.0, response = responses_[0];
+    for(size_t i = 0; i < n; i++){
+        const double nextA = a[i] * productA - b[i] * productB;
+        const double nextB = b[i] * productA + a[i] * productB;
+        const double nextX = a[i] * x - b[i] * y + xOffsets_[i];
+        const double nextY = b[i] * x + a[i] * y + yOffsets_[i];
+        productA = nextA; productB = nextB; x = nextX; y = nextY;
+        response = std::min(response, responses_[i]);
+
+        a[i] = productA;
+        b[i] = productB;
+        result.xOffsets_[i] = x;
+        result.yOffsets_[i] = y;
+        result.responses_[i] = response;
+    }
+    getScalesRotations(a, b, result.scales_, result.rotations_);
+    return result;
+}
+
+TransformTrajectory TransformTrajectory::GetInverse() const {
+    const size_t n = Size();
+    TransformTrajectory result(n);
+    std::vector<double> a, b;
+    getRotationComponents(scales_, rotations_, a, b);
+    for(size_t i = 0; i < n; i++){
+        const double squaredScale = scales_[i] * scales_[i];
+        result.xOffsets_[i] = -(a[i] * xOffsets_[i] + b[i] * yOffsets_[i]) / squaredScale;
+        result.yOffsets_[i] = (b[i] * xOffsets_[i] - a[i] * yOffsets_[i]) / squaredScale;
+        result.scales_[i] = 1.0 / scales_[i];
+        result.rotations_[i] = -rotations_[i];
+    }
+    result.responses_ = responses_;
+    return result;
+}
+
+TransformTrajectory TransformTrajectory::operator*(const TransformTrajectory& rhs) const {
+    if(rhs.Size() != Size()){
+        throw std::runtime_error("Trajectories must have the same size.");
+    }
+    const size_t n = Size();
+    TransformTrajectory result(n);
+    std::vector<double> a, b;
+    getRotationComponents(scales_, rotations_, a, b);
+    for(size_t i = 0; i < n; i++){
+        result.xOffsets_[i] = a[i] * rhs.xOffsets_[i] - b[i] * rhs.yOffsets_[i] + xOffsets_[i];
+        result.yOffsets_[i] = b[i] * rhs.xOffsets_[i] + a[i] * rhs.yOffsets_[i] + yOffsets_[i];
+        result.scales_[i] = scales_[i] * rhs.scales_[i];
+        result.rotations_[i] = rotations_[i] + rhs.rotations_[i];
+        result.responses_[i] = std::min(responses_[i], rhs.responses_[i]);
+    }
+    return result;
+}
+
+TransformTrajectory TransformTrajectory::operator*(const Transform& rhs) const {
+    TransformTrajectory rhsTrajectory(Size());
+    std::fill(rhsTrajectory.xOffsets_.begin(), rhsTrajectory.xOffsets_.end(), rhs.GetOffsetX());
+    std::fill(rhsTrajectory.yOffsets_.begin(), rhsTrajectory.yOffsets_.end(), rhs.GetOffsetY());
+    std::fill(rhsTrajectory.scales_.begin(), rhsTrajectory.scales_.end(), rhs.GetScale());
+    std::fill(rhsTrajectory.rotations_.begin(), rhsTrajectory.rotations_.end(), rhs.GetRotation());
+    std::fill(rhsTrajectory.responses_.begin(), rhsTrajectory.responses_.end(), rhs.GetResponse());
+    return *this * rhsTrajectory;
+}
+
+// Rotations without jumps of more than 180 degrees between neighbors
+static std::vector<double> getUnwrappedRotations(std::span<const double> rotations) {
+    std::vector<double> unwrapped(rotations.begin(), rotations.end());
+    for(size_t i = 1; i < unwrapped.size(); i++){
+        const double step = unwrapped[i] - unwrapped[i - 1];
+        unwrapped[i] -= 360.0 * std::round(step / 360.0);
+    }
+    return unwrapped;
+}
+
+template <typename Function>
+TransformTrajectory TransformTrajectory::GetSmoothed(Function smooth) const {
+    TransformTrajectory result(Size());
+    if(Size() == 0){
+        return result;
+    }
+
+    std::vector<double> logScales(Size());
+    std::transform(scales_.begin(), scales_.end(), logScales.begin(), [](double s){ return std::log(s); });
+
+    result.xOffsets_ = smooth(xOffsets_);
+    result.yOffsets_ = smooth(yOffsets_);
+    result.scales_ = smooth(logScales);
+    std::transform(result.scales_.begin(), result.scales_.end(), result.scales_.begin(), [](double s){ return std::exp(s); });
+    result.rotations_ = smooth(getUnwrappedRotations(rotations_));
+    result.responses_ = responses_;
+    return result;
+}
+
+// `values` filtered with `kernel` of odd size, renormalized over the part of
+// the kernel inside the array at the ends
+static std::vector<double> getConvolved(const std::vector<double>& values, const std::vector<double>& kernel) {
+    const int n = values.size();
+    const int radius = kernel.size() / 2;
+    std::vector<double> result(n);
+    for(int i = 0; i < n; i++){
+        const int first = std::max(0, i - radius);
+        const int last = std::min(n - 1, i + radius);
+        double sum = 0.0;
+        double weight = 0.0;
+        for(int j = first; j <= last; j++){
+            sum += kernel[j - i + radius] * values[j];
+            weight += kernel[j - i + radius];
+        }
+        result[i] = sum / weight;
+    }
+    return result;
+}
+
+TransformTrajectory TransformTrajectory::GetMovingAverage(int radius) const {
+    CV_Assert(radius >= 0);
+    const std::vector<double> kernel(2 * radius + 1, 1.0);
+    return GetSmoothed([&](const std::vector<double>& values){ return getConvolved(values, kernel); });
+}
+
+TransformTrajectory TransformTrajectory::GetGaussianSmoothed(double sigma) const {
+    CV_Assert(sigma > 0.0);
+    const int radius = std::ceil(3.0 * sigma);
+    std::vector<double> kernel(2 * radius + 1);
+    for(int i = -radius; i <= radius; i++){
+        kernel[i + radius] = std::exp(-0.5 * i * i / (sigma * sigma));
+    }
+    return GetSmoothed([&](const std::vector<double>& values){ return getConvolved(values, kernel); });
+}
+
+TransformTrajectory TransformTrajectory::GetKalmanSmoothed(double processNoise, double measurementNoise) const {
+    CV_Assert(processNoise > 0.0 && measurementNoise > 0.0);
+    return GetSmoothed([&](const std::vector<double>& values){
+        const size_t n = values.size();
+        // Forward filter, keeping the predicted and filtered variances for the backward pass
+        std::vector<double> filtered(n);
+        std::vector<double> variances(n);
+        std::vector<double> predictedVariances(n);
+        filtered[0] = values[0];
+        variances[0] = measurementNoise;
+        predictedVariances[0] = measurementNoise;
+        for(size_t i = 1; i < n; i++){
+            predictedVariances[i] = variances[i - 1] + processNoise;
+            const double gain = predictedVariances[i] / (predictedVariances[i] + measurementNoise);
+            filtered[i] = filtered[i - 1] + gain * (values[i] - filtered[i - 1]);
+            variances[i] = (1.0 - gain) * predictedVariances[i];
+        }
+
+        std::vector<double> smoothed = filtered;
+        for(size_t i = n - 1; i-- > 0;){
+            const double gain = variances[i] / predictedVariances[i + 1];
+            smoothed[i] = filtered[i] + gain * (smoothed[i + 1] - filtered[i]);
+        }
+        return smoothed;
+    });
+}
@@ -0,0 +1,67 @@
+#ifndef __TRANSFORM_TRAJECTORY_H__
+#define __TRANSFORM_TRAJECTORY_H__
+
+#include <span>
+#include <vector>
+
+#include "transform.hpp"
+
+// Transforms of a sequence of frames, stored as one array per parameter so
+// that whole trajectories are composed and smoothed in tight loops instead of
+// one Transform at a time.
+class TransformTrajectory{
+public:
+    TransformTrajectory() = default;
+    explicit TransformTrajectory(size_t size);
+    explicit TransformTrajectory(std::span<const Transform> transforms);
+
+    size_t Size() const;
+    void PushBack(const Transform& transform);
+    Transform Get(size_t i) const;
+    void Set(size_t i, const Transform& transform);
+    std::vector<Transform> GetTransforms() const;
+
+    // Parameter arrays, valid until the size changes
+    std::span<double> OffsetsX() { return xOffsets_; }
+    std::span<double> OffsetsY() { return yOffsets_; }
+    std::span<double> Scales() { return scales_; }
+    std::span<double> Rotations() { return rotations_; }
+    std::span<double> Responses() { return responses_; }
+    std::span<const double> OffsetsX() const { return xOffsets_; }
+    std::span<const double> OffsetsY() const { return yOffsets_; }
+    std::span<const double> Scales() const { return scales_; }
+    std::span<const double> Rotations() const { return rotations_; }
+    std::span<const double> Responses() const { return responses_; }
+
+    // Element i is t_i * ... * t_1 * t_0, the total transform of frame i when
+    // every element is relative to the previous frame, as accumulated by
+    // FourierMellinContinuous
+    TransformTrajectory GetCumulative() const;
+    TransformTrajectory GetInverse() const;
+    // Element-wise products, `rhs` must have the same size
+    TransformTrajectory operator*(const TransformTrajectory& rhs) const;
+    TransformTrajectory operator*(const Transform& rhs) const;
+
+    // Smoothed offsets, scales and rotations, responses are kept. Scales are
+    // smoothed in the log domain and rotations after unwrapping, so a step
+    // from 179 to -179 degrees is smoothed as 2 degrees.
+
+    // Mean over the `radius` neighbors on both sides, fewer at the ends
+    TransformTrajectory GetMovingAverage(int radius) const;
+    TransformTrajectory GetGaussianSmoothed(double sigma) const;
+    // Rauch-Tung-Striebel smoother of a random walk, the higher
+    // `measurementNoise` is relative to `processNoise`, the smoother the result
+    TransformTrajectory GetKalmanSmoothed(double processNoise, double measurementNoise) const;
+
+private:
+    template <typename Function>
+    TransformTrajectory GetSmoothed(Function smooth) const;
+
+    std::vector<double> xOffsets_;
+    std::vector<double> yOffsets_;
+    std::vector<double> scales_;
+    std::vector<double> rotations_;
+    std::vector<double> responses_;
+};
+
+#endif // __TRANSFORM_TRAJECTORY_H__
@@ -1,36 +1,79 @@
 #include "utilities.hpp"
+#include "registration_stats.hpp"
 
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <numbers>
+#include <limits>
+#include <vector>
 #include <iostream>
 
 constexpr long double pi = std::numbers::pi_v<long double>;
 
-LogPolarMap createLogPolarMap(int cols, int rows){
+// Center of rotation and scale of `getTransformed`, also used when registering
+static cv::Point2f getImageCenter(const cv::Mat& img) {
+    return cv::Point2f(img.cols / 2.f, img.rows / 2.f);
+}
+
+cv::Size getSpectrumSize(int cols, int rows, const RegistrationOptions& options){
+    if(options.padToOptimalDftSize){
+        return cv::Size(cv::getOptimalDFTSize(cols), cv::getOptimalDFTSize(rows));
+    }
+    return cv::Size(cols, rows);
+}
+
+LogPolarMap createLogPolarMap(int cols, int rows, bool fixedPoint){
     // TODO: Improve this 
     int logPolarSize = std::max(cols, rows);
     double logBase = std::exp(std::log(logPolarSize * 1.5 / 2.0) / logPolarSize);
     float ellipse_coefficient = rows / (float)cols;
 
+    // Radii only depend on the column, so std::pow runs once per column
+    // instead of once per element
+    std::vector<float> scales(logPolarSize);
+    for(int j=0; j<logPolarSize; j++){
+        scales[j] = std::pow(logBase, j);
+    }
+
     cv::Mat xMap(logPolarSize, logPolarSize, CV_32FC1);
     cv::Mat yMap(logPolarSize, logPolarSize, CV_32FC1);
 
-    for(int i=0; i<logPolarSize; i++){
-        float angle = -(pi / logPolarSize) * i;
-        float cos_angle = std::cos(angle) / ellipse_coefficient;
-        float sin_angle = std::sin(angle);
-
-        for(int j=0; j<logPolarSize; j++){
-            float scale = std::pow(logBase, j);
-            xMap.at<float>(i, j) = scale * cos_angle + cols / 2.0f;
-            yMap.at<float>(i, j) = scale * sin_angle + rows / 2.0f;
+    cv::parallel_for_(cv::Range(0, logPolarSize), [&](const cv::Range& range){
+        for(int i=range.start; i<range.end; i++){
+            float angle = -(pi / logPolarSize) * i;
+            float cos_angle = std::cos(angle) / ellipse_coefficient;
+            float sin_angle = std::sin(angle);
+
+            float* x = xMap.ptr<float>(i);
+            float* y = yMap.ptr<float>(i);
+            for(int j=0; j<logPolarSize; j++){
+                x[j] = scales[j] * cos_angle + cols / 2.0f;
+                y[j] = scales[j] * sin_angle + rows / 2.0f;
+            }
         }
-    }
-    return LogPolarMap{
+    });
+    LogPolarMap logPolarMap{
         .logPolarSize=logPolarSize,
         .logBase=logBase,
         .xMap=xMap,
         .yMap=yMap,
     };
+    if(fixedPoint){
+        cv::convertMaps(xMap, yMap, logPolarMap.fixedMap, logPolarMap.fixedInterpolation, CV_16SC2);
+    }
+    return logPolarMap;
+}
+
+void remapLogPolar(const cv::Mat& img, cv::Mat& logPolar, const LogPolarMap& logPolarMap){
+    REGISTRATION_STAGE_TIMER(RegistrationStage::LogPolarRemap, &logPolar);
+    if(!logPolarMap.fixedMap.empty()){
+        cv::remap(img, logPolar, logPolarMap.fixedMap, logPolarMap.fixedInterpolation, cv::INTER_CUBIC, cv::BORDER_CONSTANT, cv::Scalar());
+    }
+    else{
+        cv::remap(img, logPolar, logPolarMap.xMap, logPolarMap.yMap, cv::INTER_CUBIC, cv::BORDER_CONSTANT, cv::Scalar());
+    }
 }
 
 cv::Mat getLogPolarImage(const cv::Mat& img, const cv::Mat& polarMapX, const cv::Mat& polarMapY){
@@ -43,35 +86,54 @@ cv::Mat getLogPolarImage(const cv::Mat& img, const cv::Mat& polarMapX, const cv:
 }
 
 cv::Mat fft(const cv::Mat& img) {
-    cv::Mat planes[] = {cv::Mat_<float>(img), cv::Mat::zeros(img.size(), CV_32F)};
     cv::Mat complex;
-    cv::merge(planes, 2, complex);
-    cv::dft(complex, complex, cv::DFT_COMPLEX_OUTPUT);
+    fft(cv::Mat_<float>(img), complex);
     return complex;
 }
 
+void fft(const cv::Mat& img, cv::Mat& complex) {
+    CV_Assert(img.type() == CV_32FC1);
+    // Real input, OpenCV computes only half of the spectrum and mirrors the rest
+    cv::dft(img, complex, cv::DFT_COMPLEX_OUTPUT);
+}
+
 cv::Mat fftShift(const cv::Mat& in) {
-    cv::Mat out = in.clone();
+    cv::Mat out;
+    fftShift(in, out);
+    return out;
+}
+
+void fftShift(const cv::Mat& in, cv::Mat& out) {
+    fftShift(in, out, in.rows);
+}
+
+void fftShift(const cv::Mat& in, cv::Mat& out, int rowCount) {
+    CV_Assert(in.data != out.data);
+    CV_Assert(rowCount >= 0 && rowCount <= in.rows);
+    out.create(rowCount, in.cols, in.type());
+
+    // Zero frequency ends up at (cols / 2, rows / 2), also for odd sizes
     int cx = in.cols / 2;
     int cy = in.rows / 2;
+    int cx1 = in.cols - cx;
+    int cy1 = in.rows - cy;
 
-    int cx1 = (in.cols % 2 == 0) ? cx : cx + 1;
-    int cy1 = (in.rows % 2 == 0) ? cy : cy + 1;
-
-    cv::Mat q0(out, cv::Rect(0, 0, cx, cy));
-    cv::Mat q1(out, cv::Rect(cx, 0, cx1, cy));
-    cv::Mat q2(out, cv::Rect(0, cy, cx, cy1));
-    cv::Mat q3(out, cv::Rect(cx, cy, cx1, cy1));
+    int top = std::min(cy, rowCount);
+    int bottom = rowCount - top;
 
-    cv::Mat tmp;
-    q0.copyTo(tmp);
-    q3.copyTo(q0);
-    tmp.copyTo(q3);
+    if(top > 0){
+        in(cv::Rect(cx1, cy1, cx, top)).copyTo(out(cv::Rect(0, 0, cx, top)));
+        in(cv::Rect(0, cy1, cx1, top)).copyTo(out(cv::Rect(cx, 0, cx1, top)));
+    }
+    if(bottom > 0){
+        in(cv::Rect(cx1, 0, cx, bottom)).copyTo(out(cv::Rect(0, cy, cx, bottom)));
+        in(cv::Rect(0, 0, cx1, bottom)).copyTo(out(cv::Rect(cx, cy, cx1, bottom)));
+    }
+}
 
-    q1.copyTo(tmp);
-    q2.copyTo(q1);
-    tmp.copyTo(q2);
-    return out;
+int getSpectrumBandRows(int rows) {
+    // Map reaches down to rows / 2, cubic interpolation reads two more rows
+    return std::min(rows, rows / 2 + 3);
 }
 
 cv::Mat linspace(float min, float max, size_t count){
@@ -84,31 +146,29 @@ cv::Mat linspace(float min, float max, size_t count){
 }
 
 cv::Mat getHighPassFilter(int rows, int cols) {
+    // 1 - cos^2 of the distance from the center, which is sin^2. The squared
+    // coordinates are separable, so they are computed once per row and column.
+    // Each row takes the distance with cv::sqrt and the sine with the
+    // vectorized cv::polarToCart, and the rows are filled in parallel.
     cv::Mat y = linspace(-pi / 2.0, pi / 2.0, rows);
-    cv::Mat x = linspace(-pi / 2.0, pi / 2.0, cols).t();
-    cv::Mat yMat = cv::repeat(y, 1, cols);
-    cv::Mat xMat = cv::repeat(x, rows, 1);
-
-    cv::Mat temp = yMat.mul(yMat) + xMat.mul(xMat);
-    cv::sqrt(temp, temp);
-
-    cv::Mat filter = cv::Mat(temp.size(), temp.type());
-    for(int i=0; i<temp.rows; i++){
-        for(int j=0; j<temp.cols; j++){
-            filter.at<double>(i, j) = std::cos(temp.at<double>(i, j));
+    cv::Mat x = linspace(-pi / 2.0, pi / 2.0, cols);
+    cv::Mat ySquared = y.mul(y);
+    cv::Mat xSquared = x.mul(x);
+    xSquared = xSquared.reshape(1, 1);
+    xSquared.convertTo(xSquared, CV_32F);
+
+    cv::Mat filter(rows, cols, CV_32F);
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range){
+        cv::Mat distance, cosine, sine;
+        for(int i=range.start; i<range.end; i++){
+            cv::add(xSquared, cv::Scalar(ySquared.at<double>(i, 0)), distance);
+            cv::sqrt(distance, distance);
+            cv::polarToCart(cv::noArray(), distance, cosine, sine);
+            cv::Mat out = filter.row(i);
+            cv::multiply(sine, sine, out);
         }
-    }
-
-    filter = filter.mul(filter);
-    filter = -filter + 1.0;
-
-    cv::Mat channels[] = {filter, filter};
-    cv::Mat filterTwoChannel;
-    cv::merge(channels, 2, filterTwoChannel);
-
-    cv::Mat filterConverted;
-    filterTwoChannel.convertTo(filterConverted, CV_32F);
-    return filterConverted;
+    });
+    return filter;
 }
 
 cv::Mat getApodizationWindow(int cols, int rows, int radius){
@@ -119,23 +179,148 @@ cv::Mat getApodizationWindow(int cols, int rows, int radius){
 }
 
 cv::Mat getFilteredImage(const cv::Mat &gray, const cv::Mat& apodizationWindow, const cv::Mat& highPassFilter){
-    cv::Mat apodized = gray.mul(apodizationWindow);
-    cv::Mat dftResult = fft(apodized);
-    cv::Mat filtered = fftShift(dftResult);
-    cv::multiply(filtered, highPassFilter, filtered);
-    return filtered;
+    ProcessingBuffers buffers;
+    getApodizedSpectrum(gray, apodizationWindow, highPassFilter.size(), buffers);
+
+    int bandRows = getSpectrumBandRows(buffers.spectrum.rows);
+    cv::Mat filtered = fftShift(buffers.spectrum).rowRange(0, bandRows);
+    cv::Mat planes[2];
+    cv::split(filtered, planes);
+    for(auto& plane : planes){
+        cv::multiply(plane, highPassFilter.rowRange(0, bandRows), plane);
+    }
+    cv::Mat result;
+    cv::merge(planes, 2, result);
+    return result;
+}
+
+// Zeroes everything outside the top left `size` corner of `padded`
+static void setPaddingToZero(cv::Mat& padded, cv::Size size){
+    padded(cv::Rect(size.width, 0, padded.cols - size.width, padded.rows)).setTo(0.0);
+    padded(cv::Rect(0, size.height, size.width, padded.rows - size.height)).setTo(0.0);
+}
+
+// Weights of cv::COLOR_BGR2GRAY
+constexpr float blueWeight = 0.114f;
+constexpr float greenWeight = 0.587f;
+constexpr float redWeight = 0.299f;
+
+// Luminance of `count` pixels of `in`, times `window` if it is not null
+template <typename T, int channels>
+static void getGrayRow(const T* in, const float* window, float* out, int count){
+    for(int j=0; j<count; j++){
+        const T* pixel = in + j * channels;
+        float value;
+        if constexpr(channels == 1){
+            value = static_cast<float>(pixel[0]);
+        }
+        else{
+            value = blueWeight * pixel[0] + greenWeight * pixel[1] + redWeight * pixel[2];
+        }
+        out[j] = window ? value * window[j] : value;
+    }
+}
+
+template <typename T>
+static void getGrayRows(const cv::Mat &img, const cv::Mat& window, cv::Mat& out){
+    for(int i=0; i<img.rows; i++){
+        const T* in = img.ptr<T>(i);
+        const float* windowRow = window.empty() ? nullptr : window.ptr<float>(i);
+        float* outRow = out.ptr<float>(i);
+        switch(img.channels()){
+            case 1: getGrayRow<T, 1>(in, windowRow, outRow, img.cols); break;
+            case 3: getGrayRow<T, 3>(in, windowRow, outRow, img.cols); break;
+            case 4: getGrayRow<T, 4>(in, windowRow, outRow, img.cols); break;
+        }
+    }
+}
+
+// Luminance of `img` as CV_32F into the top left of `out`, zero padded to
+// `size`, and times `window` unless it is empty
+static void getGrayImage(const cv::Mat &img, const cv::Mat& window, cv::Size size, cv::Mat& out){
+    CV_Assert(size.width >= img.cols && size.height >= img.rows);
+    if(img.channels() != 1 && img.channels() != 3 && img.channels() != 4){
+        throw std::runtime_error("Cannot convert to grayscale with " + std::to_string(img.channels()) + " channels.");
+    }
+
+    out.create(size, CV_32F);
+    switch(img.depth()){
+        case CV_8U: getGrayRows<uchar>(img, window, out); break;
+        case CV_16U: getGrayRows<ushort>(img, window, out); break;
+        case CV_32F: getGrayRows<float>(img, window, out); break;
+        case CV_64F: getGrayRows<double>(img, window, out); break;
+        default: throw std::runtime_error("Cannot convert images of depth " + std::to_string(img.depth()) + " to grayscale.");
+    }
+    setPaddingToZero(out, img.size());
+}
+
+void getApodizedImage(const cv::Mat &img, const cv::Mat& apodizationWindow, cv::Size size, cv::Mat& apodized){
+    CV_Assert(apodizationWindow.type() == CV_32FC1 && apodizationWindow.size() == img.size());
+    getGrayImage(img, apodizationWindow, size, apodized);
+}
+
+void getApodizedSpectrum(const cv::Mat &img, const cv::Mat& apodizationWindow, cv::Size size, ProcessingBuffers& buffers){
+    {
+        REGISTRATION_STAGE_TIMER(RegistrationStage::Apodization, &buffers.apodized);
+        getApodizedImage(img, apodizationWindow, size, buffers.apodized);
+    }
+    REGISTRATION_STAGE_TIMER(RegistrationStage::FFT, &buffers.spectrum);
+    fft(buffers.apodized, buffers.spectrum);
+}
+
+static void getFilteredMagnitudeRow(const cv::Vec2f* spectrum, const float* filter, float* magnitude, int count){
+    const float* in = spectrum->val;
+    int j = 0;
+#if CV_SIMD
+    constexpr int lanes = cv::v_float32::nlanes;
+    for(; j <= count - lanes; j += lanes){
+        cv::v_float32 re, im;
+        cv::v_load_deinterleave(in + 2 * j, re, im);
+        cv::v_float32 squared = cv::v_muladd(re, re, im * im);
+        cv::v_store(magnitude + j, cv::v_sqrt(squared) * cv::vx_load(filter + j));
+    }
+    cv::vx_cleanup();
+#endif
+    for(; j<count; j++){
+        magnitude[j] = std::sqrt(in[2 * j] * in[2 * j] + in[2 * j + 1] * in[2 * j + 1]) * filter[j];
+    }
+}
+
+void getFilteredMagnitude(const cv::Mat& spectrum, const cv::Mat& highPassFilter, cv::Mat& magnitude){
+    REGISTRATION_STAGE_TIMER(RegistrationStage::Filter, &magnitude);
+    CV_Assert(spectrum.type() == CV_32FC2 && highPassFilter.type() == CV_32FC1);
+    CV_Assert(spectrum.size() == highPassFilter.size());
+
+    const int rows = getSpectrumBandRows(spectrum.rows);
+    const int cols = spectrum.cols;
+    magnitude.create(rows, cols, CV_32F);
+
+    // Same quadrant mapping as fftShift
+    const int cx = cols / 2;
+    const int cy = spectrum.rows / 2;
+    const int cx1 = cols - cx;
+    const int cy1 = spectrum.rows - cy;
+
+    for(int i=0; i<rows; i++){
+        const cv::Vec2f* in = spectrum.ptr<cv::Vec2f>(i < cy ? i + cy1 : i - cy);
+        const float* filter = highPassFilter.ptr<float>(i);
+        float* out = magnitude.ptr<float>(i);
+
+        getFilteredMagnitudeRow(in + cx1, filter, out, cx);
+        getFilteredMagnitudeRow(in, filter + cx, out + cx, cx1);
+    }
 }
 
 cv::Mat getTransformed(const cv::Mat& img, const Transform& transform) {
     // TODO: Interpolation
 
-    cv::Point2f center(img.cols/2.f, img.rows/2.f);
-
-    cv::Mat rotationMatrix = cv::getRotationMatrix2D(center, transform.GetRotation(), transform.GetScale());
+    cv::Mat rotationMatrix = cv::getRotationMatrix2D(getImageCenter(img), transform.GetRotation(), transform.GetScale());
     rotationMatrix.at<double>(0, 2) += transform.GetOffsetX();
     rotationMatrix.at<double>(1, 2) += -transform.GetOffsetY();
 
-    cv::Mat transformed = img.clone();
+    cv::Mat transformed;
+    REGISTRATION_STAGE_TIMER(RegistrationStage::Warp, &transformed);
+    transformed = img.clone();
 
     cv::warpAffine(transformed, transformed, rotationMatrix, transformed.size(), cv::INTER_CUBIC);
     return transformed;
@@ -153,24 +338,206 @@ cv::Mat getCropped(const cv::Mat& img, double x1, double y1, double x2, double y
     return cropped;
 }
 
+cv::Mat getEdgeCropped(const cv::Mat& img, double edgeCrop) {
+    if(edgeCrop == 0.0){
+        return img;
+    }
+    const int cols = img.cols;
+    const int rows = img.rows;
+    cv::Mat cropped = getCropped(img, edgeCrop * cols, edgeCrop * rows, (1.0 - edgeCrop) * cols, (1.0 - edgeCrop) * rows);
+    cv::resize(cropped, cropped, cv::Size(cols, rows), cv::INTER_LINEAR);
+    return cropped;
+}
+
+Transform getPulledToCenter(const Transform& transform, double ratio) {
+    const double keep = 1.0 - ratio;
+    // Half turns both ways are the same rotation, pull along the shorter one
+    const double rotation = std::remainder(transform.GetRotation(), 360.0);
+    return Transform(
+        transform.GetOffsetX() * keep,
+        transform.GetOffsetY() * keep,
+        std::pow(transform.GetScale(), keep),
+        rotation * keep,
+        transform.GetResponse()
+    );
+}
+
+cv::Mat convertToGrayscale(const cv::Mat& img){
+    cv::Mat buffer;
+    return convertToGrayscale(img, buffer);
+}
+
+const cv::Mat& convertToGrayscale(const cv::Mat& img, cv::Mat& buffer){
+    if(img.channels() == 1){
+        return img;
+    }
+    else if(img.channels() == 3 || img.channels() == 4){
+        REGISTRATION_STAGE_TIMER(RegistrationStage::Grayscale, &buffer);
+        cv::cvtColor(img, buffer, img.channels() == 3 ? cv::COLOR_BGR2GRAY : cv::COLOR_BGRA2GRAY);
+        return buffer;
+    }
+    else{
+        throw std::runtime_error("Cannot convert to grayscale with " + std::to_string(img.channels()) + " channels.");
+    }
+}
+
 cv::Mat getProcessedImage(const cv::Mat &img, const cv::Mat& highPassFilter, const cv::Mat& apodizationWindow, const LogPolarMap& logPolarMap) {
-    auto filtered0 = getFilteredImage(img, apodizationWindow, highPassFilter);
-    auto logPolar0 = getLogPolarImage(filtered0, logPolarMap.xMap, logPolarMap.yMap);
-    return logPolar0;
+    ProcessingBuffers buffers;
+    getProcessedImage(img, highPassFilter, apodizationWindow, logPolarMap, buffers);
+    return buffers.logPolar;
+}
+
+void getProcessedImage(const cv::Mat &img, const cv::Mat& highPassFilter, const cv::Mat& apodizationWindow, const LogPolarMap& logPolarMap, ProcessingBuffers& buffers) {
+    getApodizedSpectrum(img, apodizationWindow, highPassFilter.size(), buffers);
+    getFilteredMagnitude(buffers.spectrum, highPassFilter, buffers.magnitude);
+    remapLogPolar(buffers.magnitude, buffers.logPolar, logPolarMap);
+}
+
+void getCorrelationSpectrum(const cv::Mat& img, cv::Mat& spectrum, CorrelationBuffers& buffers) {
+    auto size = cv::Size(cv::getOptimalDFTSize(img.cols), cv::getOptimalDFTSize(img.rows));
+    if(img.channels() == 1){
+        buffers.padded.create(size, CV_32F);
+        img.convertTo(buffers.padded(cv::Rect(0, 0, img.cols, img.rows)), CV_32F);
+        setPaddingToZero(buffers.padded, img.size());
+    }
+    else{
+        getGrayImage(img, cv::Mat(), size, buffers.padded);
+    }
+    cv::dft(buffers.padded, spectrum, cv::DFT_COMPLEX_OUTPUT);
+}
+
+LogPolarDescriptor getLogPolarDescriptor(const cv::Mat& logPolarSpectrum) {
+    CV_Assert(logPolarSpectrum.type() == CV_32FC2);
+    const int radius = logPolarDescriptorRadius;
+    CV_Assert(logPolarSpectrum.rows > 2 * radius && logPolarSpectrum.cols > radius);
+
+    // The spectrum of a real image is conjugate symmetric, so half of the
+    // frequencies are enough. The mean is left out.
+    LogPolarDescriptor descriptor;
+    size_t n = 0;
+    double sum = 0.0;
+    auto append = [&](int i, int j){
+        const cv::Vec2f& value = logPolarSpectrum.at<cv::Vec2f>((i + logPolarSpectrum.rows) % logPolarSpectrum.rows, j);
+        descriptor[n] = std::sqrt(value[0] * value[0] + value[1] * value[1]);
+        sum += descriptor[n] * descriptor[n];
+        n++;
+    };
+    for(int i=-radius; i<=radius; i++){
+        for(int j=1; j<=radius; j++){
+            append(i, j);
+        }
+    }
+    for(int i=1; i<=radius; i++){
+        append(i, 0);
+    }
+
+    const float norm = sum > 0.0 ? 1.0 / std::sqrt(sum) : 0.0;
+    for(auto& value : descriptor){
+        value *= norm;
+    }
+    return descriptor;
+}
+
+void getCorrelationSurface(const cv::Mat& spectrum1, const cv::Mat& spectrum0, CorrelationBuffers& buffers) {
+    CV_Assert(spectrum1.type() == CV_32FC2 && spectrum0.type() == CV_32FC2);
+    CV_Assert(spectrum1.size() == spectrum0.size());
+
+    cv::mulSpectrums(spectrum1, spectrum0, buffers.crossPower, 0, true);
+    for(int i=0; i<buffers.crossPower.rows; i++){
+        cv::Vec2f* row = buffers.crossPower.ptr<cv::Vec2f>(i);
+        for(int j=0; j<buffers.crossPower.cols; j++){
+            float magnitude = std::sqrt(row[j][0] * row[j][0] + row[j][1] * row[j][1]);
+            row[j] *= 1.0f / (magnitude + std::numeric_limits<float>::epsilon());
+        }
+    }
+    cv::idft(buffers.crossPower, buffers.correlation, cv::DFT_REAL_OUTPUT);
+}
+
+cv::Point2d phaseCorrelateSpectrums(const cv::Mat& spectrum1, const cv::Mat& spectrum0, CorrelationBuffers& buffers, double* response, int maxShift) {
+    getCorrelationSurface(spectrum1, spectrum0, buffers);
+
+    const int rows = buffers.correlation.rows;
+    const int cols = buffers.correlation.cols;
+    cv::Point peak;
+    if(maxShift < 0){
+        cv::minMaxLoc(buffers.correlation, nullptr, nullptr, nullptr, &peak);
+    }
+    else{
+        // Zero shift is at the corners of the unshifted correlation
+        const int maxShiftY = std::min(maxShift, (rows - 1) / 2);
+        const int maxShiftX = std::min(maxShift, (cols - 1) / 2);
+        float peakValue = -std::numeric_limits<float>::infinity();
+        for(int dy=-maxShiftY; dy<=maxShiftY; dy++){
+            const float* row = buffers.correlation.ptr<float>((dy + rows) % rows);
+            for(int dx=-maxShiftX; dx<=maxShiftX; dx++){
+                const int x = (dx + cols) % cols;
+                if(row[x] > peakValue){
+                    peakValue = row[x];
+                    peak = cv::Point(x, (dy + rows) % rows);
+                }
+            }
+        }
+    }
+
+    // Weighted centroid over a 5x5 window like cv::phaseCorrelate, but wrapping
+    // around the unshifted correlation instead of shifting it first
+    int peakX = peak.x < cols - cols / 2 ? peak.x : peak.x - cols;
+    int peakY = peak.y < rows - rows / 2 ? peak.y : peak.y - rows;
+    double sum = 0.0;
+    cv::Point2d centroid(0.0, 0.0);
+    for(int dy=-2; dy<=2; dy++){
+        const float* row = buffers.correlation.ptr<float>(((peak.y + dy) % rows + rows) % rows);
+        for(int dx=-2; dx<=2; dx++){
+            double value = row[((peak.x + dx) % cols + cols) % cols];
+            centroid.x += (peakX + dx) * value;
+            centroid.y += (peakY + dy) * value;
+            sum += value;
+        }
+    }
+
+    if(response){
+        *response = sum / (rows * (double)cols);
+    }
+    sum += std::numeric_limits<double>::epsilon();
+    return cv::Point2d(-centroid.x / sum, -centroid.y / sum);
+}
+
+// Same as cv::getRotationMatrix2D, without allocating
+static cv::Matx23d getRotationMatrix(cv::Point2f center, double angleDeg, double scale) {
+    double angle = angleDeg * pi / 180.0;
+    double alpha = std::cos(angle) * scale;
+    double beta = std::sin(angle) * scale;
+    return cv::Matx23d(
+        alpha, beta, (1.0 - alpha) * center.x - beta * center.y,
+        -beta, alpha, beta * center.x + (1.0 - alpha) * center.y
+    );
 }
 
 Transform registerGrayImage(const cv::Mat &img0, const cv::Mat &img1, const cv::Mat &logPolar0, const cv::Mat &logPolar1, const LogPolarMap& logPolarMap) {
-    auto[logScale, logRotation] = cv::phaseCorrelate(logPolar1, logPolar0);
-    double rotation = -logRotation / logPolarMap.logPolarSize * 180.0;
-    double scale = 1.0 / std::pow(logPolarMap.logBase, -logScale);
+    double rotation, scale;
+    {
+        REGISTRATION_STAGE_TIMER(RegistrationStage::LogPolarCorrelation);
+        auto[logScale, logRotation] = cv::phaseCorrelate(logPolar1, logPolar0);
+        rotation = -logRotation / logPolarMap.logPolarSize * 180.0;
+        scale = 1.0 / std::pow(logPolarMap.logBase, -logScale);
+    }
 
-    const auto center = cv::Point(img0.cols, img0.rows) / 2.0;
-    cv::Mat rotationMatrix = cv::getRotationMatrix2D(center, rotation, scale);
+    REGISTRATION_STAGE_TIMER(RegistrationStage::TranslationCorrelation);
+    cv::Mat rotationMatrix = cv::getRotationMatrix2D(getImageCenter(img0), rotation, scale);
     cv::Mat rotated0;
     cv::warpAffine(img0, rotated0, rotationMatrix, img0.size());
 
+    // cv::phaseCorrelate only takes floating point images, inputs may be integer
+    cv::Mat float1 = img1;
+    if(img1.depth() != CV_32F && img1.depth() != CV_64F){
+        img1.convertTo(float1, CV_32F);
+    }
+    if(rotated0.depth() != float1.depth()){
+        rotated0.convertTo(rotated0, float1.depth());
+    }
+
     double response;
-    auto[xOffset, yOffset] = cv::phaseCorrelate(img1, rotated0, cv::noArray(), &response);
+    auto[xOffset, yOffset] = cv::phaseCorrelate(float1, rotated0, cv::noArray(), &response);
 
     return Transform(
         -xOffset,
@@ -180,3 +547,131 @@ Transform registerGrayImage(const cv::Mat &img0, const cv::Mat &img1, const cv::
         response
     );
 }
+
+ReferenceSpectra getReferenceSpectra(const cv::Mat &gray, const cv::Mat& highPassFilter, const cv::Mat& apodizationWindow, const LogPolarMap& logPolarMap, RegistrationBuffers& buffers) {
+    getProcessedImage(gray, highPassFilter, apodizationWindow, logPolarMap, buffers.processing);
+
+    ReferenceSpectra reference;
+    getCorrelationSpectrum(buffers.processing.logPolar, reference.logPolarSpectrum, buffers.logPolarCorrelation);
+    getCorrelationSpectrum(gray, reference.spectrum, buffers.translationCorrelation);
+    return reference;
+}
+
+std::vector<CorrelationPeak> findCorrelationPeaks(const cv::Mat& correlation, int count) {
+    CV_Assert(correlation.type() == CV_32FC1 && count > 0);
+    const int rows = correlation.rows;
+    const int cols = correlation.cols;
+    auto at = [&](int y, int x){
+        return correlation.at<float>((y + rows) % rows, (x + cols) % cols);
+    };
+
+    // Local maxima over the 8 neighbours, wrapping around like the correlation
+    std::vector<std::pair<float, cv::Point>> maxima;
+    for(int y=0; y<rows; y++){
+        const float* row = correlation.ptr<float>(y);
+        for(int x=0; x<cols; x++){
+            float value = row[x];
+            if(maxima.size() == (size_t)count && value <= maxima.back().first){
+                continue;
+            }
+            bool isMaximum = true;
+            for(int dy=-1; dy<=1 && isMaximum; dy++){
+                for(int dx=-1; dx<=1; dx++){
+                    if((dx != 0 || dy != 0) && at(y + dy, x + dx) >= value){
+                        isMaximum = false;
+                        break;
+                    }
+                }
+            }
+            if(!isMaximum){
+                continue;
+            }
+            auto it = std::find_if(maxima.begin(), maxima.end(), [&](const auto& m){ return m.first < value; });
+            maxima.insert(it, {value, cv::Point(x, y)});
+            if(maxima.size() > (size_t)count){
+                maxima.pop_back();
+            }
+        }
+    }
+    // A flat surface, as of a constant image, has no strict local maximum
+    if(maxima.empty()){
+        double maxValue;
+        cv::Point maxLocation;
+        cv::minMaxLoc(correlation, nullptr, &maxValue, nullptr, &maxLocation);
+        maxima.push_back({(float)maxValue, maxLocation});
+    }
+
+    // Separable parabola through the peak and its neighbours in each direction
+    auto parabolaOffset = [](double left, double center, double right){
+        double denominator = left - 2.0 * center + right;
+        return denominator < 0.0 ? std::clamp(0.5 * (left - right) / denominator, -0.5, 0.5) : 0.0;
+    };
+    std::vector<CorrelationPeak> peaks;
+    peaks.reserve(maxima.size());
+    for(const auto&[value, peak] : maxima){
+        double x = (peak.x < cols - cols / 2 ? peak.x : peak.x - cols) + parabolaOffset(at(peak.y, peak.x - 1), value, at(peak.y, peak.x + 1));
+        double y = (peak.y < rows - rows / 2 ? peak.y : peak.y - rows) + parabolaOffset(at(peak.y - 1, peak.x), value, at(peak.y + 1, peak.x));
+        // Same sign convention as phaseCorrelateSpectrums
+        peaks.push_back(CorrelationPeak{cv::Point2d(-x, -y), value / (rows * (double)cols)});
+    }
+    return peaks;
+}
+
+std::tuple<double, double> getRotationScale(cv::Point2d logPolarShift, const LogPolarMap& logPolarMap) {
+    auto[logScale, logRotation] = logPolarShift;
+    double rotation = -logRotation / logPolarMap.logPolarSize * 180.0;
+    double scale = 1.0 / std::pow(logPolarMap.logBase, -logScale);
+    return {rotation, scale};
+}
+
+Transform registerTranslation(const cv::Mat &img0, double rotation, double scale, const cv::Mat& spectrum1, RegistrationBuffers& buffers) {
+    REGISTRATION_STAGE_TIMER(RegistrationStage::TranslationCorrelation, &buffers.spectrum);
+    cv::warpAffine(img0, buffers.rotated, getRotationMatrix(getImageCenter(img0), rotation, scale), img0.size());
+    // Translation is correlated at the image size (padded by getCorrelationSpectrum like
+    // cv::phaseCorrelate), so offsets are in image pixels regardless of the spectrum size
+    getCorrelationSpectrum(buffers.rotated, buffers.spectrum, buffers.translationCorrelation);
+
+    double response;
+    auto[xOffset, yOffset] = phaseCorrelateSpectrums(spectrum1, buffers.spectrum, buffers.translationCorrelation, &response);
+
+    return Transform(
+        -xOffset,
+        yOffset,
+        scale,
+        rotation,
+        response
+    );
+}
+
+Transform registerGrayImage(const cv::Mat &img0, const cv::Mat &logPolar0, const ReferenceSpectra& reference1, const LogPolarMap& logPolarMap, RegistrationBuffers& buffers) {
+    double rotation, scale;
+    {
+        REGISTRATION_STAGE_TIMER(RegistrationStage::LogPolarCorrelation, &buffers.logPolarSpectrum);
+        getCorrelationSpectrum(logPolar0, buffers.logPolarSpectrum, buffers.logPolarCorrelation);
+        std::tie(rotation, scale) = getRotationScale(phaseCorrelateSpectrums(reference1.logPolarSpectrum, buffers.logPolarSpectrum, buffers.logPolarCorrelation), logPolarMap);
+    }
+    return registerTranslation(img0, rotation, scale, reference1.spectrum, buffers);
+}
+
+Transform refineTranslation(const cv::Mat &img0, const Transform& coarse, const cv::Rect& window, const cv::Mat& refinementSpectrum1, int searchRadius, RegistrationBuffers& buffers) {
+    REGISTRATION_STAGE_TIMER(RegistrationStage::TranslationCorrelation, &buffers.spectrum);
+    // Same matrix as getTransformed, shifted so that only the window is warped
+    cv::Matx23d matrix = getRotationMatrix(getImageCenter(img0), coarse.GetRotation(), coarse.GetScale());
+    matrix(0, 2) += coarse.GetOffsetX() - window.x;
+    matrix(1, 2) += -coarse.GetOffsetY() - window.y;
+    cv::warpAffine(img0, buffers.rotated, matrix, window.size());
+    getCorrelationSpectrum(buffers.rotated, buffers.spectrum, buffers.translationCorrelation);
+
+    double response;
+    // A periodic texture or a second strong peak farther away must not pull
+    // the result away from the coarse estimate
+    auto[xOffset, yOffset] = phaseCorrelateSpectrums(refinementSpectrum1, buffers.spectrum, buffers.translationCorrelation, &response, searchRadius);
+
+    return Transform(
+        coarse.GetOffsetX() - xOffset,
+        coarse.GetOffsetY() + yOffset,
+        coarse.GetScale(),
+        coarse.GetRotation(),
+        response
+    );
+}
@@ -5,37 +5,216 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <array>
 #include "transform.hpp"
 
+struct RegistrationOptions{
+    // Compute spectrums at cv::getOptimalDFTSize instead of the image size.
+    // Transforms are still given in the pixel coordinates of the image.
+    bool padToOptimalDftSize = false;
+    // Remap the spectrum with fixed-point maps from cv::convertMaps. Faster,
+    // but coordinates are quantized to 1/32 of a pixel.
+    bool fixedPointLogPolarMap = false;
+    // Estimate rotation, scale and a coarse translation on images downscaled
+    // by 2^pyramidLevels, then refine the translation at full resolution on a
+    // central window of 64 * 2^pyramidLevels pixels, searching only a few
+    // downscaled pixels around the coarse estimate. 0 registers at full
+    // resolution only.
+    int pyramidLevels = 0;
+    // Number of log-polar correlation peaks tried as rotation and scale, each
+    // also rotated by 180 degrees. The candidates are scored by a translation
+    // correlation on a small image. 0 takes the highest peak only.
+    int rotationScaleCandidates = 0;
+    // `RegistrationMode::Auto` runs the full registration when the response
+    // of the translation-only registration is below this
+    double autoModeResponseThreshold = 0.3;
+};
+
+enum class RegistrationMode{
+    // Rotation, scale and translation
+    Full,
+    // Only a translation correlation against the reference, rotation and scale are not estimated
+    TranslationOnly,
+    // TranslationOnly, falling back to Full when its response is low
+    Auto,
+};
+
 struct LogPolarMap{
     int logPolarSize;
     double logBase;
     cv::Mat xMap;
     cv::Mat yMap;
+    // Optional CV_16SC2 + CV_16UC1 conversion of xMap and yMap, used by remap when not empty
+    cv::Mat fixedMap;
+    cv::Mat fixedInterpolation;
+};
+
+// Scratch buffers for `getProcessedImage`, reused between calls so that
+// repeated processing of same sized images does not allocate.
+struct ProcessingBuffers{
+    cv::Mat grayBuffer;
+    cv::Mat apodized;
+    cv::Mat spectrum;
+    cv::Mat magnitude;
+    cv::Mat logPolar;
+};
+
+// Scratch buffers for phase correlation of precomputed spectrums.
+struct CorrelationBuffers{
+    cv::Mat padded;
+    cv::Mat crossPower;
+    cv::Mat correlation;
+};
+
+// Spectrums of a reference image, enough to register other images against it
+struct ReferenceSpectra{
+    cv::Mat spectrum;
+    cv::Mat logPolarSpectrum;
+    // Full resolution spectrum of the refinement window, only with pyramid levels
+    cv::Mat refinementSpectrum;
+    // Spectrum of the downscaled image, only with rotation and scale candidates
+    cv::Mat scoringSpectrum;
 };
 
-LogPolarMap createLogPolarMap(int cols, int rows);
+// Subpixel shift of a correlation peak, in the convention of `phaseCorrelateSpectrums`
+struct CorrelationPeak{
+    cv::Point2d shift;
+    // Normalized like the response of `phaseCorrelateSpectrums`
+    double value;
+};
+
+struct RegistrationBuffers{
+    ProcessingBuffers processing;
+    // Gray second image of pairwise registrations, the first one is in `processing.grayBuffer`
+    cv::Mat referenceGray;
+    CorrelationBuffers logPolarCorrelation;
+    CorrelationBuffers translationCorrelation;
+    cv::Mat logPolarSpectrum;
+    cv::Mat rotated;
+    cv::Mat spectrum;
+    cv::Mat pyramid;
+    cv::Mat scoring;
+};
+
+// Size at which spectrums are computed for images of size `cols` x `rows`
+cv::Size getSpectrumSize(int cols, int rows, const RegistrationOptions& options);
+
+LogPolarMap createLogPolarMap(int cols, int rows, bool fixedPoint = false);
+
+// Log-polar remap of `img` using the fixed-point maps of `logPolarMap` if present
+void remapLogPolar(const cv::Mat& img, cv::Mat& logPolar, const LogPolarMap& logPolarMap);
 
 cv::Mat getLogPolarImage(const cv::Mat& img, const cv::Mat& polarMapX, const cv::Mat& polarMapY);
 
 cv::Mat fft(const cv::Mat& img);
 
+// `img` must be CV_32FC1, the full complex spectrum is written to `complex`
+void fft(const cv::Mat& img, cv::Mat& complex);
+
 cv::Mat fftShift(const cv::Mat& in);
 
+void fftShift(const cv::Mat& in, cv::Mat& out);
+
+// Writes only the first `rowCount` rows of the shifted result
+void fftShift(const cv::Mat& in, cv::Mat& out, int rowCount);
+
+// Number of rows at the top of the shifted spectrum read by the log-polar map.
+// The map covers angles [0, pi), the other half is redundant for a real image.
+int getSpectrumBandRows(int rows);
+
 cv::Mat getHighPassFilter(int rows, int cols);
 
 cv::Mat getApodizationWindow(int cols, int rows, int radius);
 
 cv::Mat getFilteredImage(const cv::Mat &gray, const cv::Mat& apodizationWindow, const cv::Mat& highPassFilter);
 
+// Luminance of `img` times `apodizationWindow` into the top left of the
+// CV_32F `apodized`, zero padded to `size`, in a single pass. `img` may be
+// gray, BGR or BGRA with uint8, uint16, float or double elements, and is not
+// normalized, as the correlations do not depend on the scale of intensities.
+void getApodizedImage(const cv::Mat &img, const cv::Mat& apodizationWindow, cv::Size size, cv::Mat& apodized);
+
+// Spectrum of the apodized image in `buffers.spectrum`, unshifted. If `size` is
+// larger than `img`, the apodized image is zero padded to it. Takes the same
+// images as `getApodizedImage`.
+void getApodizedSpectrum(const cv::Mat &img, const cv::Mat& apodizationWindow, cv::Size size, ProcessingBuffers& buffers);
+
+// Magnitude of the shifted and high-pass filtered `spectrum` in one pass, limited
+// to the top `getSpectrumBandRows` rows. Reads the unshifted spectrum directly,
+// `highPassFilter` is a single plane in the shifted layout of `getHighPassFilter`.
+void getFilteredMagnitude(const cv::Mat& spectrum, const cv::Mat& highPassFilter, cv::Mat& magnitude);
+
 cv::Mat getTransformed(const cv::Mat& img, const Transform& transform);
 
 cv::Mat getCropped(const cv::Mat& img, double x1, double y1, double x2, double y2);
 
+// Crops `edgeCrop` of the size from every edge and resizes back to the size of `img`
+cv::Mat getEdgeCropped(const cv::Mat& img, double edgeCrop);
+
+// `transform` moved towards the identity by `ratio` of its offset, rotation
+// and log scale. Applied to an accumulated transform on every frame, it decays
+// geometrically instead of drifting.
+Transform getPulledToCenter(const Transform& transform, double ratio);
+
+cv::Mat convertToGrayscale(const cv::Mat& img);
+
+// Returns `img` itself if it is already single channel, `buffer` otherwise.
+// Takes gray, BGR and BGRA images.
+const cv::Mat& convertToGrayscale(const cv::Mat& img, cv::Mat& buffer);
+
 cv::Mat getProcessedImage(const cv::Mat &img, const cv::Mat& highPassFilter, const cv::Mat& apodizationWindow, const LogPolarMap& logPolarMap);
 
+// Result is stored in `buffers.logPolar`
+void getProcessedImage(const cv::Mat &img, const cv::Mat& highPassFilter, const cv::Mat& apodizationWindow, const LogPolarMap& logPolarMap, ProcessingBuffers& buffers);
+
+// Spectrum of `img` as used by `phaseCorrelateSpectrums`, zero padded to an optimal DFT size like in cv::phaseCorrelate.
+// BGR and BGRA images are converted to grayscale in the same pass as the padding.
+void getCorrelationSpectrum(const cv::Mat& img, cv::Mat& spectrum, CorrelationBuffers& buffers);
+
+// Equivalent to cv::phaseCorrelate(img1, img0) given the spectrums of both images
+// With a non-negative `maxShift`, only shifts of at most that many pixels in
+// each direction are searched for the peak.
+cv::Point2d phaseCorrelateSpectrums(const cv::Mat& spectrum1, const cv::Mat& spectrum0, CorrelationBuffers& buffers, double* response = nullptr, int maxShift = -1);
+
+// Correlation surface of `phaseCorrelateSpectrums` in `buffers.correlation`, unshifted
+void getCorrelationSurface(const cv::Mat& spectrum1, const cv::Mat& spectrum0, CorrelationBuffers& buffers);
+
+// Frequencies in each direction kept by `getLogPolarDescriptor`
+constexpr int logPolarDescriptorRadius = 4;
+constexpr int logPolarDescriptorSize = (2 * logPolarDescriptorRadius + 1) * logPolarDescriptorRadius + logPolarDescriptorRadius;
+using LogPolarDescriptor = std::array<float, logPolarDescriptorSize>;
+
+// Rotation and scale invariant signature of an image given the spectrum of its
+// log-polar image. Rotation and scale shift the log-polar image, which only
+// changes the phase of its spectrum, so the low frequency magnitudes are kept.
+// Normalized to unit length, the dot product of two is their similarity.
+LogPolarDescriptor getLogPolarDescriptor(const cv::Mat& logPolarSpectrum);
+
+// Up to `count` highest local maxima of `correlation`, highest first, refined
+// to subpixel positions by fitting a parabola in each direction
+std::vector<CorrelationPeak> findCorrelationPeaks(const cv::Mat& correlation, int count);
+
+// Rotation in degrees and scale of a shift between log-polar images
+std::tuple<double, double> getRotationScale(cv::Point2d logPolarShift, const LogPolarMap& logPolarMap);
+
+// Rotates and scales `img0` and registers the translation against the image of `spectrum1`
+Transform registerTranslation(const cv::Mat &img0, double rotation, double scale, const cv::Mat& spectrum1, RegistrationBuffers& buffers);
+
+// `img0` and `img1` may be of any depth, integer images are converted to float for correlation
 Transform registerGrayImage(const cv::Mat &img0, const cv::Mat &img1, const cv::Mat &logPolar0, const cv::Mat &logPolar1, const LogPolarMap& logPolarMap);
 
+ReferenceSpectra getReferenceSpectra(const cv::Mat &gray, const cv::Mat& highPassFilter, const cv::Mat& apodizationWindow, const LogPolarMap& logPolarMap, RegistrationBuffers& buffers);
+
+// Registers `img0` against a reference of which only the correlation spectrums are known
+Transform registerGrayImage(const cv::Mat &img0, const cv::Mat &logPolar0, const ReferenceSpectra& reference1, const LogPolarMap& logPolarMap, RegistrationBuffers& buffers);
+
+// Refines the translation of `coarse`, estimated on downscaled images and given
+// in full resolution pixels. `img0` is warped by `coarse` and only `window` of
+// it is correlated with `refinementSpectrum1`, the spectrum of the same window
+// of the reference as given by `getCorrelationSpectrum`. The correction is
+// searched within `searchRadius` pixels of the coarse estimate.
+Transform refineTranslation(const cv::Mat &img0, const Transform& coarse, const cv::Rect& window, const cv::Mat& refinementSpectrum1, int searchRadius, RegistrationBuffers& buffers);
+
 // cv::Mat phaseCorrelateWithImage();
 
 #endif // __UTILITIES_H__
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "video_stabilization.hpp"
+#include "fourier_mellin_pipelined.hpp"
+
+#include <exception>
+#include <thread>
+
+std::vector<Transform> StabilizeVideo(const std::string& input, const std::string& output, const StabilizationOptions& options) {
+    cv::VideoCapture capture(input);
+    if(!capture.isOpened()){
+        throw std::runtime_error("Cannot open video " + input);
+    }
+    const int cols = capture.get(cv::CAP_PROP_FRAME_WIDTH);
+    const int rows = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+    const double fps = capture.get(cv::CAP_PROP_FPS);
+
+    if(options.fourcc.size() != 4){
+        throw std::runtime_error("FourCC must have 4 characters, got " + options.fourcc);
+    }
+    const auto& c = options.fourcc;
+    cv::VideoWriter writer(output, cv::VideoWriter::fourcc(c[0], c[1], c[2], c[3]), fps, cv::Size(cols, rows));
+    if(!writer.isOpened()){
+        throw std::runtime_error("Cannot open video " + output + " for writing");
+    }
+
+    FourierMellinContinuousPipelined stabilizer(cols, rows, options.edgeCrop, options.pullToCenterRatio, options.queueDepth, options.registration, options.keyframes);
+
+    // Decoding runs on its own thread, the pipeline registers and this thread encodes
+    cv::Mat firstFrame;
+    std::exception_ptr decodeError;
+    std::thread decoder([&]{
+        try{
+            cv::Mat frame;
+            while(capture.read(frame)){
+                if(firstFrame.empty()){
+                    firstFrame = frame.clone();
+                }
+                stabilizer.PushImage(frame);
+            }
+        }
+        catch(...){
+            decodeError = std::current_exception();
+        }
+        stabilizer.Finish();
+    });
+
+    std::vector<Transform> transforms;
+    try{
+        while(auto result = stabilizer.PopRegisteredImage()){
+            auto&[stabilized, transform] = *result;
+            // The first frame is the reference of the others, written unchanged
+            writer.write(stabilized.empty() ? getEdgeCropped(firstFrame, options.edgeCrop) : stabilized);
+            transforms.push_back(transform);
+        }
+    }
+    catch(...){
+        // Releases the decoder if it is waiting for room in the pipeline
+        stabilizer.Finish();
+        decoder.join();
+        throw;
+    }
+
+    decoder.join();
+    if(decodeError){
+        std::rethrow_exception(decodeError);
+    }
+    return transforms;
+}
@@ -0,0 +1,28 @@
+#ifndef __VIDEO_STABILIZATION_H__
+#define __VIDEO_STABILIZATION_H__
+
+#include <string>
+#include <vector>
+
+#include "utilities.hpp"
+#include "transform.hpp"
+#include "fourier_mellin.hpp"
+
+struct StabilizationOptions{
+    double edgeCrop = 0.1;
+    double pullToCenterRatio = 0.07;
+    // Frames held between each of the decode, registration and encode stages
+    size_t queueDepth = 8;
+    // Codec of the output file
+    std::string fourcc = "mp4v";
+    RegistrationOptions registration;
+    KeyframeOptions keyframes;
+};
+
+// Stabilizes the video in `input` with FourierMellinContinuous and writes it to
+// `output` at the same size and frame rate. Decoding, the registration stages
+// and encoding run on separate threads. Returns the total transform of every
+// frame, the identity for the first one. Throws if either file cannot be opened.
+std::vector<Transform> StabilizeVideo(const std::string& input, const std::string& output, const StabilizationOptions& options = {});
+
+#endif // __VIDEO_STABILIZATION_H__
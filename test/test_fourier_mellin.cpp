@@ -4,9 +4,14 @@
 #include <numeric>
 #include <random>
 #include <filesystem>
+#include <fstream>
+#include <thread>
 
 // TODO: Fix project include structure in src/CMakeLists.txt
 #include "../src/fourier_mellin.hpp"
+#include "../src/fourier_mellin_fast.hpp"
+#include "../src/fourier_mellin_pipelined.hpp"
+#include "../src/video_stabilization.hpp"
 #include "../src/transform.hpp"
 
 cv::Mat GetL2Difference(const cv::Mat& a, const cv::Mat& b){
@@ -167,6 +172,145 @@ TEST(ImageTransformConsistency3, BasicAssertions) {
     }
 }
 
+TEST(SpectrumBand1, BasicAssertions) {
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_GRAYSCALE);
+    img.convertTo(img, CV_32F);
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+
+    int cols = img.size().width;
+    int rows = img.size().height;
+    auto highPassFilter = getHighPassFilter(rows, cols);
+    auto apodizationWindow = getApodizationWindow(cols, rows, std::min(rows, cols));
+    auto logPolarMap = createLogPolarMap(cols, rows);
+
+    // Complex transform of the whole spectrum
+    cv::Mat planes[] = {img.mul(apodizationWindow), cv::Mat::zeros(img.size(), CV_32F)};
+    cv::Mat complex;
+    cv::merge(planes, 2, complex);
+    cv::dft(complex, complex, cv::DFT_COMPLEX_OUTPUT);
+    cv::Mat filtered = fftShift(complex);
+    cv::Mat filterPlanes[] = {highPassFilter, highPassFilter};
+    cv::Mat filterTwoChannel;
+    cv::merge(filterPlanes, 2, filterTwoChannel);
+    cv::multiply(filtered, filterTwoChannel, filtered);
+    auto expected = getLogPolarImage(filtered, logPolarMap.xMap, logPolarMap.yMap);
+
+    auto logPolar = getProcessedImage(img, highPassFilter, apodizationWindow, logPolarMap);
+
+    EXPECT_EQ(getFilteredImage(img, apodizationWindow, highPassFilter).rows, getSpectrumBandRows(rows));
+    EXPECT_LE(cv::norm(logPolar, expected, cv::NORM_INF), 1e-3 * cv::norm(expected, cv::NORM_INF));
+}
+
+TEST(PlanGenerators1, BasicAssertions) {
+    // Per-element definitions of the filter and the map
+    for(auto size : {cv::Size(64, 48), cv::Size(53, 37), cv::Size(7, 5)}){
+        const int cols = size.width;
+        const int rows = size.height;
+
+        auto highPassFilter = getHighPassFilter(rows, cols);
+        ASSERT_EQ(highPassFilter.size(), size);
+        for(int i=0; i<rows; i++){
+            for(int j=0; j<cols; j++){
+                double y = -CV_PI / 2.0 + CV_PI * i / (rows - 1);
+                double x = -CV_PI / 2.0 + CV_PI * j / (cols - 1);
+                double c = std::cos(std::sqrt(x * x + y * y));
+                EXPECT_NEAR(highPassFilter.at<float>(i, j), 1.0 - c * c, 1e-5);
+            }
+        }
+
+        auto logPolarMap = createLogPolarMap(cols, rows);
+        const int logPolarSize = logPolarMap.logPolarSize;
+        ASSERT_EQ(logPolarSize, std::max(cols, rows));
+        for(int i=0; i<logPolarSize; i++){
+            double angle = -CV_PI / logPolarSize * i;
+            for(int j=0; j<logPolarSize; j++){
+                double scale = std::pow(logPolarMap.logBase, j);
+                double x = scale * std::cos(angle) * cols / rows + cols / 2.0;
+                double y = scale * std::sin(angle) + rows / 2.0;
+                EXPECT_NEAR(logPolarMap.xMap.at<float>(i, j), x, 1e-4 * std::max(1.0, std::abs(x)));
+                EXPECT_NEAR(logPolarMap.yMap.at<float>(i, j), y, 1e-4 * std::max(1.0, std::abs(y)));
+            }
+        }
+    }
+}
+
+TEST(ApodizedImage1, BasicAssertions) {
+    auto img = readImage("images/lenna_small_center.png");
+    const cv::Size size = img.size();
+    const cv::Size padded(size.width + 5, size.height + 3);
+    auto apodizationWindow = getApodizationWindow(size.width, size.height, std::min(size.width, size.height));
+
+    cv::Mat expected;
+    cv::multiply(convertToGrayscale(img), apodizationWindow, expected, 1.0, CV_32F);
+
+    cv::Mat bgra;
+    cv::cvtColor(img, bgra, cv::COLOR_BGR2BGRA);
+    for(const cv::Mat& color : {img, bgra, convertToGrayscale(img)}){
+        for(int depth : {CV_8U, CV_16U, CV_32F}){
+            cv::Mat converted;
+            color.convertTo(converted, depth);
+
+            cv::Mat apodized;
+            getApodizedImage(converted, apodizationWindow, padded, apodized);
+            ASSERT_EQ(apodized.size(), padded);
+            ASSERT_EQ(apodized.type(), CV_32FC1);
+            // Integer images lose the fractions of the luminance
+            EXPECT_LE(cv::norm(apodized(cv::Rect(cv::Point(), size)), expected, cv::NORM_INF), depth == CV_32F ? 1e-3 : 1.0);
+            EXPECT_EQ(cv::countNonZero(apodized.colRange(size.width, padded.width)), 0);
+            EXPECT_EQ(cv::countNonZero(apodized.rowRange(size.height, padded.height)), 0);
+        }
+    }
+
+    // Registration takes BGRA like BGR
+    Transform t_01(-30, 20, 0.65, -20, 1);
+    auto img_01 = getTransformed(img, t_01);
+    cv::Mat bgra_01;
+    cv::cvtColor(img_01, bgra_01, cv::COLOR_BGR2BGRA);
+    FourierMellin fm(size.width, size.height);
+    auto[transformed, transform] = fm.GetRegisteredImage(img, img_01);
+    auto[transformedBgra, transformBgra] = fm.GetRegisteredImage(bgra, bgra_01);
+    EXPECT_EQ(transformedBgra.channels(), 4);
+    expectTransformsNear({transform, transformBgra, t_01});
+
+    // Correlation spectrums convert color images while padding them
+    CorrelationBuffers buffers;
+    cv::Mat graySpectrum, colorSpectrum;
+    getCorrelationSpectrum(convertToGrayscale(img), graySpectrum, buffers);
+    getCorrelationSpectrum(img, colorSpectrum, buffers);
+    EXPECT_LE(cv::norm(colorSpectrum, graySpectrum, cv::NORM_INF) / cv::norm(graySpectrum, cv::NORM_INF), 1e-2);
+
+    // Registration with a plan passes color images through without a separate conversion
+    for(const auto& options : {RegistrationOptions{}, RegistrationOptions{.pyramidLevels=1}, RegistrationOptions{.rotationScaleCandidates=4}}){
+        FourierMellinFast fast(size.width, size.height, options);
+        fast.SetReference(convertToGrayscale(img_01));
+        auto grayTransform = fast.GetTransform(convertToGrayscale(img));
+        fast.SetReference(img_01);
+        expectTransformsNear({grayTransform, fast.GetTransform(img), fast.GetTransform(bgra), t_01});
+    }
+}
+
+TEST(FilteredMagnitude1, BasicAssertions) {
+    // Odd widths exercise the scalar tail after the vectorized part
+    for(auto size : {cv::Size(64, 48), cv::Size(53, 37), cv::Size(7, 5)}){
+        cv::Mat spectrum(size, CV_32FC2);
+        cv::randu(spectrum, cv::Scalar::all(-100.0), cv::Scalar::all(100.0));
+        auto highPassFilter = getHighPassFilter(size.height, size.width);
+
+        cv::Mat magnitude;
+        getFilteredMagnitude(spectrum, highPassFilter, magnitude);
+
+        cv::Mat planes[2];
+        cv::split(fftShift(spectrum), planes);
+        cv::Mat expected;
+        cv::magnitude(planes[0], planes[1], expected);
+        expected = expected.mul(highPassFilter);
+        expected = expected.rowRange(0, getSpectrumBandRows(size.height));
+
+        EXPECT_EQ(magnitude.size(), expected.size());
+        EXPECT_LE(cv::norm(magnitude, expected, cv::NORM_INF), 1e-3);
+    }
+}
+
 TEST(BasicFourierMellin1, BasicAssertions) {
     constexpr bool saveFiles = false;
     Transform t_01(-30, 20, 0.65, -20, 1);
@@ -196,6 +340,673 @@ TEST(BasicFourierMellin1, BasicAssertions) {
     EXPECT_GE(transform.GetResponse(), 0.5);
 }
 
+TEST(FourierMellinFast1, BasicAssertions) {
+    constexpr unsigned iterations = 3;
+    Transform t_01(-30, 20, 0.65, -20, 1);
+
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_COLOR);
+    img.convertTo(img, CV_32FC(3));
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+
+    auto img_01 = getTransformed(img, t_01);
+
+    FourierMellin fm(img.size().width, img.size().height);
+    FourierMellinFast fmFast(img.size().width, img.size().height);
+    fmFast.SetReference(img_01);
+
+    auto[transformed, transformReference] = fm.GetRegisteredImage(img, img_01);
+    for(unsigned i=0; i<iterations; i++){
+        auto transform = fmFast.GetTransform(img);
+        expectTransformsNear({transform, transformReference, t_01});
+        EXPECT_NEAR(transform.GetResponse(), transformReference.GetResponse(), 5e-2);
+    }
+}
+
+TEST(RegistrationStats1, BasicAssertions) {
+    if(!registrationStatsEnabled){
+        GTEST_SKIP() << "Built without FOURIER_MELLIN_STATS";
+    }
+    constexpr unsigned iterations = 3;
+    Transform t_01(-30, 20, 0.65, -20, 1);
+
+    auto img = readImage("images/lenna_small_center.png");
+    auto img_01 = getTransformed(img, t_01);
+
+    auto getStage = [](const std::vector<StageStats>& stats, RegistrationStage stage){
+        return stats.at(static_cast<size_t>(stage));
+    };
+
+    FourierMellinFast fmFast(img.size().width, img.size().height);
+    fmFast.SetReference(img_01);
+    for(unsigned i=0; i<iterations; i++){
+        fmFast.GetTransform(img);
+    }
+    auto stats = fmFast.GetStats();
+    ASSERT_EQ(stats.size(), static_cast<size_t>(RegistrationStage::Count));
+    EXPECT_EQ(getStage(stats, RegistrationStage::Grayscale).calls, iterations + 1);
+    EXPECT_EQ(getStage(stats, RegistrationStage::FFT).calls, iterations + 1);
+    EXPECT_EQ(getStage(stats, RegistrationStage::LogPolarCorrelation).calls, iterations);
+    EXPECT_EQ(getStage(stats, RegistrationStage::Warp).calls, 0u);
+    // Buffers are only allocated on the first call
+    EXPECT_EQ(getStage(stats, RegistrationStage::FFT).allocations, 1u);
+    for(const auto& stage : stats){
+        EXPECT_FALSE(stage.stage.empty());
+        EXPECT_LE(stage.p50Milliseconds, stage.p99Milliseconds);
+        EXPECT_LE(stage.p99Milliseconds, stage.totalMilliseconds);
+    }
+
+    fmFast.ResetStats();
+    EXPECT_EQ(getStage(fmFast.GetStats(), RegistrationStage::FFT).calls, 0u);
+
+    // Registrations on the thread pool count towards the instance
+    FourierMellinWithReference fm(img.size().width, img.size().height);
+    fm.SetReference(img_01);
+    fm.SetThreadCount(2);
+    std::vector<cv::Mat> imgs(4, img);
+    fm.GetRegisteredImageBatch(imgs);
+    stats = fm.GetStats();
+    EXPECT_EQ(getStage(stats, RegistrationStage::LogPolarCorrelation).calls, imgs.size());
+    EXPECT_EQ(getStage(stats, RegistrationStage::Warp).calls, imgs.size());
+}
+
+TEST(RegistrationPlanCache1, BasicAssertions) {
+    Transform t_01(-30, 20, 0.65, -20, 1);
+
+    auto img = readImage("images/lenna_small_center.png");
+    auto img_01 = getTransformed(img, t_01);
+    const int cols = img.size().width;
+    const int rows = img.size().height;
+
+    auto plan = getRegistrationPlan(cols, rows);
+    EXPECT_EQ(plan, getRegistrationPlan(cols, rows));
+    EXPECT_NE(plan, getRegistrationPlan(cols, rows, RegistrationOptions{.pyramidLevels=1}));
+    EXPECT_NE(plan, getRegistrationPlan(cols / 2, rows));
+
+    auto directory = std::filesystem::temp_directory_path() / "fourier_mellin_plan_cache_test";
+    std::filesystem::remove_all(directory);
+    setRegistrationPlanCacheDirectory(directory.string());
+    clearRegistrationPlanCache();
+
+    // Created and saved, then loaded from the file after clearing the memory
+    RegistrationOptions options{.fixedPointLogPolarMap=true};
+    auto created = getRegistrationPlan(cols, rows, options);
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator()), 1);
+    clearRegistrationPlanCache();
+    auto loaded = getRegistrationPlan(cols, rows, options);
+
+    // A file holding the plan of other options is not used
+    getRegistrationPlan(cols, rows);
+    std::vector<std::filesystem::path> files(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator());
+    ASSERT_EQ(files.size(), 2u);
+    if(loadRegistrationPlan(files[0].string())->logPolarMap.fixedMap.empty()){
+        std::swap(files[0], files[1]);
+    }
+    std::filesystem::copy_file(files[0], files[1], std::filesystem::copy_options::overwrite_existing);
+    clearRegistrationPlanCache();
+    EXPECT_TRUE(getRegistrationPlan(cols, rows)->logPolarMap.fixedMap.empty());
+
+    setRegistrationPlanCacheDirectory("");
+    std::filesystem::remove_all(directory);
+
+    ASSERT_NE(created, loaded);
+    EXPECT_NE(loaded->storage, nullptr);
+    EXPECT_EQ(loaded->spectrumSize, created->spectrumSize);
+    EXPECT_EQ(loaded->logPolarMap.logBase, created->logPolarMap.logBase);
+    EXPECT_EQ(cv::norm(loaded->highPassFilter, created->highPassFilter, cv::NORM_INF), 0.0);
+    EXPECT_EQ(cv::norm(loaded->logPolarMap.xMap, created->logPolarMap.xMap, cv::NORM_INF), 0.0);
+    EXPECT_EQ(cv::norm(loaded->logPolarMap.fixedMap, created->logPolarMap.fixedMap, cv::NORM_INF), 0.0);
+
+    auto[transformedCreated, transformCreated] = FourierMellin(created).GetRegisteredImage(img, img_01);
+    auto[transformedLoaded, transformLoaded] = FourierMellin(loaded).GetRegisteredImage(img, img_01);
+    expectTransformsNear({transformCreated, transformLoaded, t_01});
+
+    // Changed headers or a different size are always rejected, changed data
+    // only when verified
+    auto path = (std::filesystem::temp_directory_path() / "fourier_mellin_plan_test.bin").string();
+    auto flipByte = [&](std::streamoff offset, std::ios::seekdir direction){
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(offset, direction);
+        char value = file.get();
+        file.seekp(offset, direction);
+        file.put(value ^ 0x55);
+    };
+    saveRegistrationPlan(*created, path);
+    EXPECT_NE(loadRegistrationPlan(path, true), nullptr);
+    flipByte(-1, std::ios::end);
+    EXPECT_NE(loadRegistrationPlan(path), nullptr);
+    EXPECT_THROW(loadRegistrationPlan(path, true), std::runtime_error);
+    saveRegistrationPlan(*created, path);
+    flipByte(8, std::ios::beg);
+    EXPECT_THROW(loadRegistrationPlan(path), std::runtime_error);
+    saveRegistrationPlan(*created, path);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    EXPECT_THROW(loadRegistrationPlan(path), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(FourierMellinWithReferenceDesignations1, BasicAssertions) {
+    Transform t_01(-30, 20, 0.65, -20, 1);
+    Transform t_02(15, -10, 1.1, 10, 1);
+
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_COLOR);
+    img.convertTo(img, CV_32FC(3));
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+
+    auto img_01 = getTransformed(img, t_01);
+    auto img_02 = getTransformed(img, t_02);
+
+    FourierMellin fm(img.size().width, img.size().height);
+    FourierMellinWithReference fmReference(img.size().width, img.size().height);
+    fmReference.SetReference(img_01, 1);
+    fmReference.SetReference(img_02, 2);
+
+    auto[transformed_01, transform_01] = fm.GetRegisteredImage(img, img_01);
+    auto[transformed_02, transform_02] = fm.GetRegisteredImage(img, img_02);
+
+    expectTransformsNear({fmReference.GetRegisteredImageTransform(img), transform_02, t_02});
+    fmReference.SetReferenceWithDesignation(1);
+    expectTransformsNear({fmReference.GetRegisteredImageTransform(img), transform_01, t_01});
+    fmReference.SetReferenceWithDesignation(2);
+    expectTransformsNear({fmReference.GetRegisteredImageTransform(img), transform_02, t_02});
+}
+
+TEST(FourierMellinWithReferenceSearch1, BasicAssertions) {
+    Transform t_01(-10, 15, 0.9, 25, 1);
+
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_COLOR);
+    img.convertTo(img, CV_32FC(3));
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+    auto img_01 = getTransformed(img, t_01);
+
+    FourierMellinWithReference fmReference(img.size().width, img.size().height);
+    EXPECT_TRUE(fmReference.SearchReferences(img).empty());
+
+    // Unrelated references of smoothed noise around the one that matches
+    cv::RNG rng(5);
+    for(int i=0; i<5; i++){
+        cv::Mat noise(img.size(), CV_32FC3);
+        rng.fill(noise, cv::RNG::UNIFORM, 0.0, 255.0);
+        cv::GaussianBlur(noise, noise, cv::Size(), 1.0 + i);
+        fmReference.SetReference(noise, i);
+    }
+    fmReference.SetReference(img_01, 7);
+    fmReference.SetReferenceWithDesignation(0);
+
+    auto results = fmReference.SearchReferences(img, 2);
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(std::get<0>(results[0]), 7);
+    EXPECT_GE(std::get<1>(results[0]).GetResponse(), std::get<1>(results[1]).GetResponse());
+    expectTransformsNear({std::get<1>(results[0]), t_01});
+
+    // Replacing a reference keeps the rest, the count is limited to the number of references
+    fmReference.SetReference(img_01, 3);
+    results = fmReference.SearchReferences(img, 10);
+    ASSERT_EQ(results.size(), 6u);
+    EXPECT_TRUE(std::get<0>(results[0]) == 3 || std::get<0>(results[0]) == 7);
+    expectTransformsNear({std::get<1>(results[0]), std::get<1>(results[1]), t_01});
+
+    // Searching does not change the current reference
+    expectTransformsNear({fmReference.GetRegisteredImageTransform(img), t_01});
+}
+
+TEST(FourierMellinWithReferenceThreads1, BasicAssertions) {
+    constexpr unsigned threadCount = 4;
+    constexpr unsigned iterations = 5;
+    Transform t_01(-30, 20, 0.65, -20, 1);
+    Transform t_02(15, -10, 1.1, 10, 1);
+
+    auto img = readImage("images/lenna_small_center.png");
+    auto img_01 = getTransformed(img, t_01);
+    auto img_02 = getTransformed(img, t_02);
+
+    auto plan = createRegistrationPlan(img.size().width, img.size().height);
+    FourierMellin fm(plan);
+    FourierMellinWithReference fmReference(plan);
+    fmReference.SetReference(img_01, 1);
+    fmReference.SetReference(img_02, 2);
+
+    auto[transformed_01, transform_01] = fm.GetRegisteredImage(img, img_01);
+    auto[transformed_02, transform_02] = fm.GetRegisteredImage(img, img_02);
+
+    // Registrations must match one of the references while another thread switches between them
+    std::vector<Transform> results[threadCount];
+    std::vector<std::thread> threads;
+    for(unsigned i=0; i<threadCount; i++){
+        threads.emplace_back([&, i]{
+            for(unsigned j=0; j<iterations; j++){
+                results[i].push_back(fmReference.GetRegisteredImageTransform(img));
+            }
+        });
+    }
+    for(unsigned j=0; j<iterations; j++){
+        fmReference.SetReferenceWithDesignation(j % 2 + 1);
+        fmReference.SetReference(j % 2 == 0 ? img_01 : img_02, j % 2 + 1);
+    }
+    for(auto& thread : threads){
+        thread.join();
+    }
+
+    for(const auto& transforms : results){
+        ASSERT_EQ(transforms.size(), iterations);
+        for(const auto& transform : transforms){
+            bool isFirst = std::abs(transform.GetScale() - transform_01.GetScale()) < std::abs(transform.GetScale() - transform_02.GetScale());
+            expectTransformsNear({transform, isFirst ? transform_01 : transform_02});
+        }
+    }
+}
+
+TEST(ThreadPool1, BasicAssertions) {
+    ThreadPool pool(3);
+    constexpr size_t count = 1000;
+
+    // Loops of several callers share the workers, every index runs once
+    std::vector<std::vector<std::atomic<int>>> calls(4);
+    std::vector<std::thread> callers;
+    for(auto& c : calls){
+        c = std::vector<std::atomic<int>>(count);
+        callers.emplace_back([&]{
+            pool.ParallelFor(count, [&](size_t i){ c[i]++; });
+        });
+    }
+    for(auto& caller : callers){
+        caller.join();
+    }
+    for(const auto& c : calls){
+        EXPECT_TRUE(std::all_of(c.begin(), c.end(), [](const auto& n){ return n == 1; }));
+    }
+
+    EXPECT_THROW(pool.ParallelFor(count, [](size_t i){
+        if(i == 500){
+            throw std::runtime_error("failed");
+        }
+    }), std::runtime_error);
+    pool.ParallelFor(0, [](size_t){});
+}
+
+TEST(FourierMellinWithReferenceBatch1, BasicAssertions) {
+    const std::vector<Transform> ts = {
+        Transform(-30, 20, 0.65, -20, 1),
+        Transform(15, -10, 1.1, 10, 1),
+        Transform(-20, 15, 0.8, -20, 1),
+        Transform(10, -5, 1.1, 30, 1),
+        Transform(-30, 20, 0.95, -15, 1),
+    };
+
+    auto img = readImage("images/lenna_small_center.png");
+    std::vector<cv::Mat> imgs;
+    for(const auto& t : ts){
+        imgs.push_back(getTransformed(img, t.GetInverse()));
+    }
+
+    FourierMellinWithReference fmReference(img.size().width, img.size().height);
+    fmReference.SetReference(img);
+
+    for(unsigned threadCount : {1u, 3u, 0u}){
+        fmReference.SetThreadCount(threadCount);
+        auto transforms = fmReference.RegisterBatch(imgs);
+        auto results = fmReference.GetRegisteredImageBatch(imgs);
+        ASSERT_EQ(transforms.size(), imgs.size());
+        ASSERT_EQ(results.size(), imgs.size());
+        for(size_t i=0; i<imgs.size(); i++){
+            auto transform = fmReference.GetRegisteredImageTransform(imgs[i]);
+            expectTransformsNear({transforms[i], std::get<1>(results[i]), transform}, 1e-6, 1e-6, 1e-6);
+            EXPECT_EQ(std::get<0>(results[i]).size(), img.size());
+        }
+    }
+}
+
+TEST(FourierMellinContinuousPipelined1, BasicAssertions) {
+    constexpr unsigned iterations = 8;
+    Transform t_01(-4, 3, 0.98, 2, 1);
+
+    auto img = readImage("images/lenna_small_center.png");
+    std::vector<cv::Mat> imgs;
+    Transform t;
+    for(unsigned i=0; i<iterations; i++){
+        imgs.push_back(getTransformed(img, t));
+        t *= t_01;
+    }
+
+    int cols = img.size().width;
+    int rows = img.size().height;
+    for(size_t depth : {1, 3}){
+        FourierMellinContinuous fm(cols, rows);
+        FourierMellinContinuousPipelined fmPipelined(cols, rows, 0.1, 0.07, depth);
+
+        // Pushing from another thread lets the pipeline fill up and block
+        std::thread producer([&]{
+            for(const auto& frame : imgs){
+                fmPipelined.PushImage(frame);
+            }
+            fmPipelined.Finish();
+        });
+
+        for(const auto& frame : imgs){
+            auto[transformed, transform] = fm.GetRegisteredImage(frame);
+            auto result = fmPipelined.PopRegisteredImage();
+            ASSERT_TRUE(result.has_value());
+            auto&[transformedPipelined, transformPipelined] = *result;
+
+            expectTransformsNear({transformPipelined, transform}, 1e-6, 1e-6, 1e-6);
+            EXPECT_EQ(transformedPipelined.size(), transformed.size());
+            if(!transformed.empty()){
+                EXPECT_EQ(cv::norm(transformedPipelined, transformed, cv::NORM_INF), 0.0);
+            }
+        }
+        EXPECT_FALSE(fmPipelined.PopRegisteredImage().has_value());
+        producer.join();
+    }
+}
+
+TEST(TranslationOnlyFourierMellin1, BasicAssertions) {
+    Transform t_translation(-12, 7, 1, 0, 1);
+    Transform t_rotation(-12, 7, 0.9, 20, 1);
+
+    auto img = readImage("images/lenna_small_center.png");
+    int cols = img.size().width;
+    int rows = img.size().height;
+
+    for(int levels : {0, 1}){
+        FourierMellinFast fm(cols, rows, RegistrationOptions{.pyramidLevels=levels});
+        fm.SetReference(getTransformed(img, t_translation));
+
+        auto transform = fm.GetTransform(img, RegistrationMode::TranslationOnly);
+        expectTransformsNear({transform, fm.GetTransform(img), t_translation});
+        EXPECT_EQ(transform.GetScale(), 1.0);
+        EXPECT_EQ(transform.GetRotation(), 0.0);
+        EXPECT_GE(transform.GetResponse(), 0.5);
+        expectTransformsNear({fm.GetTransform(img, RegistrationMode::Auto), t_translation});
+
+        // A rotated image correlates poorly by translation only, so auto mode falls back to the full registration
+        fm.SetReference(getTransformed(img, t_rotation));
+        EXPECT_LT(fm.GetTransform(img, RegistrationMode::TranslationOnly).GetResponse(), 0.3);
+        expectTransformsNear({fm.GetTransform(img, RegistrationMode::Auto), fm.GetTransform(img), t_rotation});
+    }
+}
+
+TEST(StabilizeVideo1, BasicAssertions) {
+    constexpr int frameCount = 6;
+    Transform t_01(-4, 3, 1.0, 1, 1);
+
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_COLOR);
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+
+    auto directory = std::filesystem::temp_directory_path();
+    auto input = (directory / "fourier_mellin_shaky.avi").string();
+    auto output = (directory / "fourier_mellin_stabilized.avi").string();
+    {
+        cv::VideoWriter writer(input, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 30.0, img.size());
+        ASSERT_TRUE(writer.isOpened());
+        Transform t;
+        for(int i=0; i<frameCount; i++){
+            writer.write(getTransformed(img, t));
+            t *= t_01;
+        }
+    }
+
+    FourierMellinContinuous fm(img.size().width, img.size().height);
+    cv::VideoCapture capture(input);
+    std::vector<Transform> expected;
+    cv::Mat frame;
+    while(capture.read(frame)){
+        expected.push_back(std::get<1>(fm.GetRegisteredImage(frame)));
+    }
+
+    StabilizationOptions options;
+    options.fourcc = "MJPG";
+    auto transforms = StabilizeVideo(input, output, options);
+    ASSERT_EQ(transforms.size(), frameCount);
+    for(int i=0; i<frameCount; i++){
+        expectTransformsNear({transforms[i], expected[i]}, 1e-6, 1e-6, 1e-6);
+    }
+
+    cv::VideoCapture stabilized(output);
+    EXPECT_EQ(stabilized.get(cv::CAP_PROP_FRAME_COUNT), frameCount);
+    EXPECT_EQ(stabilized.get(cv::CAP_PROP_FRAME_WIDTH), img.size().width);
+
+    EXPECT_THROW(StabilizeVideo((directory / "fourier_mellin_missing.avi").string(), output), std::runtime_error);
+    std::filesystem::remove(input);
+    std::filesystem::remove(output);
+}
+
+TEST(PullToCenter1, BasicAssertions) {
+    Transform t_01(-8, 6, 1.1, 10, 1);
+
+    auto pulled = getPulledToCenter(t_01, 0.5);
+    expectTransformsNear({pulled, Transform(-4, 3, std::sqrt(1.1), 5, 1)}, 1e-9, 1e-9, 1e-9);
+    expectTransformsNear({getPulledToCenter(t_01, 0.0), t_01}, 1e-9, 1e-9, 1e-9);
+    expectTransformsNear({getPulledToCenter(t_01, 1.0), Transform()}, 1e-9, 1e-9, 1e-9);
+    // 350 degrees is pulled through 360, not back through 180
+    EXPECT_NEAR(getPulledToCenter(Transform(0, 0, 1, 350, 1), 0.5).GetRotation(), -5, 1e-9);
+
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_COLOR);
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+    auto img_01 = getTransformed(img, t_01);
+
+    // Without pulling the shake is kept, with pulling it decays towards the identity frame by frame
+    FourierMellinContinuous fm(img.size().width, img.size().height, 0.1, 0.0);
+    FourierMellinContinuous fmPulled(img.size().width, img.size().height, 0.1, 0.5);
+    fm.GetRegisteredImage(img);
+    fmPulled.GetRegisteredImage(img);
+    Transform expected = t_01;
+    for(int i=0; i<3; i++){
+        expected = getPulledToCenter(expected, 0.5);
+        auto transform = std::get<1>(fm.GetRegisteredImage(img_01));
+        auto transformPulled = std::get<1>(fmPulled.GetRegisteredImage(img_01));
+        expectTransformsNear({transform, t_01});
+        expectTransformsNear({transformPulled, expected});
+    }
+
+    EXPECT_THROW(FourierMellinContinuous(img.size().width, img.size().height, 0.1, 1.5), cv::Exception);
+}
+
+TEST(KeyframeFourierMellin1, BasicAssertions) {
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_COLOR);
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+
+    // A static start followed by a steady pan
+    std::vector<cv::Mat> frames{img, img, img};
+    std::vector<Transform> expected{Transform(), Transform(), Transform()};
+    for(int i=1; i<=8; i++){
+        expected.emplace_back(3 * i, -2 * i, 1.0, 0.0, 1.0);
+        frames.push_back(getTransformed(img, expected.back()));
+    }
+
+    // About two steps of the pan
+    KeyframeOptions keyframes{.enabled=true, .maxOffset=8.0 / std::max(img.size().width, img.size().height)};
+    FourierMellinContinuous fm(img.size().width, img.size().height, 0.1, 0.0);
+    FourierMellinContinuous fmKeyframes(img.size().width, img.size().height, 0.1, 0.0, {}, keyframes);
+    for(size_t i=0; i<frames.size(); i++){
+        auto transform = std::get<1>(fm.GetRegisteredImage(frames[i]));
+        auto transformKeyframes = std::get<1>(fmKeyframes.GetRegisteredImage(frames[i]));
+        if(i > 0){
+            expectTransformsNear({transformKeyframes, transform, expected[i]});
+        }
+        if(i < 3){
+            EXPECT_EQ(fmKeyframes.GetKeyframeCount(), 1u);
+        }
+    }
+    // The pan moves past the offset bound, but not on every frame
+    EXPECT_GT(fmKeyframes.GetKeyframeCount(), 1u);
+    EXPECT_LT(fmKeyframes.GetKeyframeCount(), frames.size() - 3);
+    EXPECT_EQ(fm.GetKeyframeCount(), 0u);
+}
+
+TEST(PaddedFourierMellin1, BasicAssertions) {
+    Transform t_01(-20, 15, 0.8, -20, 1);
+
+    auto img = cv::imread("images/lenna_small_center.png", cv::IMREAD_COLOR);
+    img.convertTo(img, CV_32FC(3));
+    EXPECT_NE(img.size(), cv::Size(0, 0));
+
+    // Crop to a size that cv::getOptimalDFTSize pads in both dimensions
+    auto awkwardSize = [](int n){
+        while(n > 1 && cv::getOptimalDFTSize(n) == n){
+            n--;
+        }
+        return n;
+    };
+    int cols = awkwardSize(img.size().width);
+    int rows = awkwardSize(img.size().height);
+    img = img(cv::Rect(0, 0, cols, rows)).clone();
+    auto img_01 = getTransformed(img, t_01);
+
+    RegistrationOptions options{.padToOptimalDftSize=true};
+    EXPECT_NE(getSpectrumSize(cols, rows, options), cv::Size(cols, rows));
+
+    FourierMellin fm(cols, rows);
+    FourierMellin fmPadded(cols, rows, options);
+    auto[transformed, transform] = fm.GetRegisteredImage(img, img_01);
+    auto[transformedPadded, transformPadded] = fmPadded.GetRegisteredImage(img, img_01);
+
+    EXPECT_EQ(transformedPadded.size(), img.size());
+    expectTransformsNear({transformPadded, transform, t_01});
+    EXPECT_GE(transformPadded.GetResponse(), 0.5);
+}
+
+TEST(FixedPointLogPolarMap1, BasicAssertions) {
+    const std::vector<Transform> ts = {
+        Transform(-20, 15, 0.8, -20, 1),
+        Transform(-30, 20, 0.95, -15, 1),
+        Transform(10, -5, 1.1, 30, 1),
+    };
+
+    auto img = readImage("images/lenna_small_center.png");
+    int cols = img.size().width;
+    int rows = img.size().height;
+
+    auto logPolarMap = createLogPolarMap(cols, rows, true);
+    EXPECT_EQ(logPolarMap.fixedMap.type(), CV_16SC2);
+    EXPECT_EQ(logPolarMap.fixedInterpolation.type(), CV_16UC1);
+
+    FourierMellin fm(cols, rows);
+    FourierMellin fmFixed(cols, rows, RegistrationOptions{.fixedPointLogPolarMap=true});
+    for(const auto& t_01 : ts){
+        auto img_01 = getTransformed(img, t_01);
+        auto[transformed, transform] = fm.GetRegisteredImage(img, img_01);
+        auto[transformedFixed, transformFixed] = fmFixed.GetRegisteredImage(img, img_01);
+
+        expectTransformsNear({transformFixed, transform, t_01});
+        EXPECT_NEAR(transformFixed.GetResponse(), transform.GetResponse(), 5e-2);
+    }
+}
+
+TEST(PyramidFourierMellin1, BasicAssertions) {
+    const std::vector<Transform> ts = {
+        Transform(-20, 15, 0.8, -20, 1),
+        Transform(-30, 20, 0.95, -15, 1),
+        Transform(10, -5, 1.1, 30, 1),
+    };
+
+    auto img = readImage("images/lenna.png");
+    int cols = img.size().width;
+    int rows = img.size().height;
+
+    FourierMellin fm(cols, rows);
+    for(int levels : {1, 2}){
+        RegistrationOptions options{.pyramidLevels=levels};
+        auto plan = createRegistrationPlan(cols, rows, options);
+        EXPECT_EQ(plan->processingSize, cv::Size(cols >> levels, rows >> levels));
+
+        FourierMellin fmPyramid(plan);
+        FourierMellinWithReference fmReference(plan);
+        for(const auto& t_01 : ts){
+            auto img_01 = getTransformed(img, t_01);
+            auto[transformed, transform] = fm.GetRegisteredImage(img, img_01);
+            auto[transformedPyramid, transformPyramid] = fmPyramid.GetRegisteredImage(img, img_01);
+            fmReference.SetReference(img_01);
+
+            // Translation is refined at full resolution, so offsets are as accurate as without levels
+            expectTransformsNear({transformPyramid, fmReference.GetRegisteredImageTransform(img), transform, t_01});
+            EXPECT_GE(transformPyramid.GetResponse(), 0.5);
+            EXPECT_EQ(transformedPyramid.size(), img.size());
+        }
+    }
+}
+
+TEST(CorrelationPeaks1, BasicAssertions) {
+    cv::Mat correlation = cv::Mat::zeros(64, 64, CV_32F);
+    // Peaks between pixels, one wrapping around the border
+    auto addPeak = [&](cv::Point2d center, double height){
+        for(int y=0; y<correlation.rows; y++){
+            for(int x=0; x<correlation.cols; x++){
+                double dx = std::remainder(x - center.x, correlation.cols);
+                double dy = std::remainder(y - center.y, correlation.rows);
+                correlation.at<float>(y, x) += height * std::exp(-(dx * dx + dy * dy) / 2.0);
+            }
+        }
+    };
+    addPeak({10.3, 20.0}, 1.0);
+    addPeak({62.0, 40.6}, 0.5);
+
+    auto peaks = findCorrelationPeaks(correlation, 3);
+    ASSERT_GE(peaks.size(), 2);
+    EXPECT_NEAR(peaks[0].shift.x, -10.3, 0.1);
+    EXPECT_NEAR(peaks[0].shift.y, -20.0, 0.1);
+    EXPECT_NEAR(peaks[1].shift.x, 2.0, 0.1);
+    EXPECT_NEAR(peaks[1].shift.y, 64 - 40.6, 0.1);
+    EXPECT_GT(peaks[0].value, peaks[1].value);
+
+    // A flat surface still gives its maximum
+    ASSERT_EQ(findCorrelationPeaks(cv::Mat::zeros(64, 64, CV_32F), 3).size(), 1u);
+}
+
+TEST(LimitedPeakSearch1, BasicAssertions) {
+    cv::Mat img(128, 128, CV_32F);
+    cv::RNG(3).fill(img, cv::RNG::UNIFORM, 0.0, 1.0);
+    auto shifted = [&](double x){
+        cv::Mat result;
+        cv::warpAffine(img, result, cv::Matx23d(1, 0, x, 0, 1, 0), img.size(), cv::INTER_LINEAR, cv::BORDER_WRAP);
+        return result;
+    };
+    // A weak peak near zero and a stronger one far from it
+    cv::Mat img1 = 0.5 * shifted(2) + shifted(30);
+
+    CorrelationBuffers buffers;
+    cv::Mat spectrum0, spectrum1;
+    getCorrelationSpectrum(img, spectrum0, buffers);
+    getCorrelationSpectrum(img1, spectrum1, buffers);
+    EXPECT_NEAR(std::abs(phaseCorrelateSpectrums(spectrum1, spectrum0, buffers).x), 30, 0.5);
+    EXPECT_NEAR(std::abs(phaseCorrelateSpectrums(spectrum1, spectrum0, buffers, nullptr, 4).x), 2, 0.5);
+}
+
+TEST(RotationScaleCandidates2, BasicAssertions) {
+    // A constant image has a flat log-polar correlation surface
+    cv::Mat img(96, 128, CV_8UC3, cv::Scalar(128, 128, 128));
+    FourierMellinWithReference fm(img.size().width, img.size().height, RegistrationOptions{.rotationScaleCandidates=3});
+    fm.SetReference(img);
+    auto candidates = fm.GetRegistrationCandidates(img);
+    ASSERT_GE(candidates.size(), 1u);
+    auto transform = fm.GetRegisteredImageTransform(img);
+    EXPECT_TRUE(std::isfinite(transform.GetOffsetX()) && std::isfinite(transform.GetOffsetY()));
+    EXPECT_TRUE(std::isfinite(transform.GetScale()) && std::isfinite(transform.GetRotation()));
+}
+
+TEST(RotationScaleCandidates1, BasicAssertions) {
+    const std::vector<Transform> ts = {
+        Transform(-20, 15, 0.8, -20, 1),
+        Transform(10, -5, 1.1, 30, 1),
+        // Only distinguishable from -30 degrees by the candidate scoring
+        Transform(10, -5, 0.95, 150, 1),
+    };
+
+    auto img = readImage("images/lenna_small_center.png");
+    int cols = img.size().width;
+    int rows = img.size().height;
+
+    FourierMellinWithReference fm(cols, rows, RegistrationOptions{.rotationScaleCandidates=3});
+    for(const auto& t_01 : ts){
+        fm.SetReference(getTransformed(img, t_01));
+        auto candidates = fm.GetRegistrationCandidates(img);
+        ASSERT_GE(candidates.size(), 2);
+        EXPECT_EQ(candidates.size() % 2, 0);
+        expectTransformsNear({candidates.front(), fm.GetRegisteredImageTransform(img), t_01});
+        for(size_t i=2; i<candidates.size(); i++){
+            EXPECT_GE(candidates[i - 1].GetResponse(), candidates[i].GetResponse());
+        }
+    }
+}
+
 TEST(ChainedFourierMellin1, BasicAssertions) {
     constexpr bool saveFiles = false;
     constexpr unsigned iterations = 5;
@@ -2,9 +2,11 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 
 // TODO: Fix project include structure in src/CMakeLists.txt
 #include "../src/transform.hpp"
+#include "../src/transform_trajectory.hpp"
 
 TEST(DefaultConstructor, BasicAssertions) {
     Transform t;
@@ -178,3 +180,90 @@ TEST(RandomWalk, BasicAssertions) {
     EXPECT_NEAR(t3.GetScale(), s3, 1e-6);
     EXPECT_NEAR(t3.GetRotation(), r3, 1e-6);
 }
+
+TEST(MatrixEquivalence, BasicAssertions) {
+    std::vector<Transform> ts = {
+        Transform(-12, 34, 1.234, -12.34, 0.5),
+        Transform(3.5, -1.25, 0.8, 170.0, 0.7),
+        Transform(0.0, 7.0, 1.0, -95.0, 0.9),
+    };
+
+    auto expectNear = [](const cv::Matx33d& a, const cv::Matx33d& b){
+        EXPECT_LE(cv::norm(a, b, cv::NORM_INF), 1e-9);
+    };
+
+    for(const auto& t1 : ts){
+        expectNear(t1.GetMatx(), cv::Matx33d(t1.GetMatrix()));
+        expectNear(t1.GetInverse().GetMatx(), t1.GetMatx().inv());
+        expectNear((t1 * t1.GetInverse()).GetMatx(), cv::Matx33d::eye());
+        EXPECT_DOUBLE_EQ(t1.GetInverse().GetResponse(), t1.GetResponse());
+
+        Transform fromMatx(t1.GetMatx(), t1.GetResponse());
+        EXPECT_NEAR(fromMatx.GetRotation(), t1.GetRotation(), 1e-9);
+        EXPECT_NEAR(fromMatx.GetScale(), t1.GetScale(), 1e-12);
+
+        for(const auto& t2 : ts){
+            auto t3 = t1 * t2;
+            expectNear(t3.GetMatx(), t1.GetMatx() * t2.GetMatx());
+            EXPECT_DOUBLE_EQ(t3.GetResponse(), std::min(t1.GetResponse(), t2.GetResponse()));
+        }
+    }
+
+    // Setters keep the cached rotation in sync
+    Transform t(1.0, 2.0, 1.5, 10.0);
+    t.SetRotation(-30.0);
+    t.SetScale(0.5);
+    expectNear(t.GetMatx(), Transform(1.0, 2.0, 0.5, -30.0).GetMatx());
+}
+
+TEST(TrajectoryCumulative, BasicAssertions) {
+    std::vector<Transform> steps;
+    for(int i=0; i<50; i++){
+        steps.emplace_back(std::sin(i) * 3.0, std::cos(i) * 2.0, 1.0 + 0.01 * std::sin(0.3 * i), 7.0 * std::cos(0.2 * i), 1.0 - 0.01 * i);
+    }
+    TransformTrajectory trajectory(steps);
+    ASSERT_EQ(trajectory.Size(), steps.size());
+
+    auto cumulative = trajectory.GetCumulative();
+    auto inverse = trajectory.GetInverse();
+    Transform total;
+    for(size_t i=0; i<steps.size(); i++){
+        total = i == 0 ? steps[0] : steps[i] * total;
+        auto t = cumulative.Get(i);
+        EXPECT_NEAR(t.GetOffsetX(), total.GetOffsetX(), 1e-9);
+        EXPECT_NEAR(t.GetOffsetY(), total.GetOffsetY(), 1e-9);
+        EXPECT_NEAR(t.GetScale(), total.GetScale(), 1e-12);
+        EXPECT_NEAR(t.GetRotation(), total.GetRotation(), 1e-9);
+        EXPECT_DOUBLE_EQ(t.GetResponse(), total.GetResponse());
+
+        auto identity = (trajectory * inverse).Get(i);
+        EXPECT_NEAR(identity.GetOffsetX(), 0.0, 1e-9);
+        EXPECT_NEAR(identity.GetOffsetY(), 0.0, 1e-9);
+        EXPECT_NEAR(identity.GetScale(), 1.0, 1e-12);
+        EXPECT_NEAR(identity.GetRotation(), 0.0, 1e-9);
+    }
+}
+
+TEST(TrajectorySmoothing, BasicAssertions) {
+    // A slow pan with jitter, rotating across +-180 degrees
+    TransformTrajectory trajectory;
+    for(int i=0; i<200; i++){
+        double jitter = (i % 2 == 0) ? 1.0 : -1.0;
+        double rotation = std::remainder(175.0 + 0.05 * i + 0.5 * jitter, 360.0);
+        trajectory.PushBack(Transform(0.5 * i + jitter, -0.25 * i, 1.0 + 0.01 * jitter, rotation, 0.8));
+    }
+
+    for(const auto& smoothed : {trajectory.GetMovingAverage(5), trajectory.GetGaussianSmoothed(3.0), trajectory.GetKalmanSmoothed(1e-2, 1.0)}){
+        ASSERT_EQ(smoothed.Size(), trajectory.Size());
+        // Away from the ends the jitter is removed and the pan kept
+        for(size_t i=20; i<180; i++){
+            auto t = smoothed.Get(i);
+            EXPECT_NEAR(t.GetOffsetX(), 0.5 * i, 0.3);
+            EXPECT_NEAR(t.GetOffsetY(), -0.25 * i, 0.3);
+            EXPECT_NEAR(t.GetScale(), 1.0, 3e-3);
+            double rotationError = std::remainder(t.GetRotation() - (175.0 + 0.05 * i), 360.0);
+            EXPECT_NEAR(rotationError, 0.0, 0.2);
+            EXPECT_DOUBLE_EQ(t.GetResponse(), 0.8);
+        }
+    }
+}
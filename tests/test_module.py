@@ -1,4 +1,33 @@
+import numpy as np
 import fourier_mellin
 
 def test_module():
     assert hasattr(fourier_mellin, 'Transform')
+
+def test_stats():
+    img = np.random.default_rng(0).random((64, 64, 3), dtype=np.float32)
+    fm = fourier_mellin.FourierMellin(64, 64)
+    fm.register_image(img, img)
+
+    stats = fm.stats()
+    assert "fft" in stats and "warp" in stats
+    if fourier_mellin.stats_enabled:
+        assert stats["fft"]["calls"] == 2
+        assert stats["warp"]["calls"] == 1
+        assert stats["fft"]["p50_ms"] <= stats["fft"]["p99_ms"]
+
+    fm.reset_stats()
+    assert fm.stats()["fft"]["calls"] == 0
+
+def test_search_references():
+    rng = np.random.default_rng(0)
+    imgs = [rng.random((64, 64, 3), dtype=np.float32) for _ in range(3)]
+    fm = fourier_mellin.FourierMellinWithReference(64, 64)
+    for designation, img in enumerate(imgs):
+        fm.set_reference(img, designation)
+
+    results = fm.search_references(imgs[1], count=2)
+    assert len(results) == 2
+    designation, transform = results[0]
+    assert designation == 1
+    assert abs(transform.x()) < 1 and abs(transform.y()) < 1
@@ -0,0 +1,47 @@
+import fourier_mellin
+import numpy as np
+import cv2
+
+def _images():
+    img = cv2.imread("./resources/dog_reference.png")
+    rows, cols = img.shape[:2]
+    matrix = cv2.getRotationMatrix2D((cols / 2, rows / 2), 5, 0.95)
+    matrix[:, 2] += (8, -4)
+    return img, cv2.warpAffine(img, matrix, (cols, rows))
+
+def test_dtypes():
+    img0, img1 = _images()
+    rows, cols = img0.shape[:2]
+    fm = fourier_mellin.FourierMellin(cols, rows)
+
+    _, expected = fm.register_image(img0.astype(np.float32), img1.astype(np.float32))
+    for dtype in (np.uint8, np.uint16, np.float32):
+        transformed, transform = fm.register_image(img0.astype(dtype), img1.astype(dtype))
+        assert transformed.dtype == dtype
+        assert transformed.shape == img0.shape
+        assert abs(transform.x() - expected.x()) < 1.0
+        assert abs(transform.y() - expected.y()) < 1.0
+        assert abs(transform.rotation() - expected.rotation()) < 1.0
+        assert abs(transform.scale() - expected.scale()) < 1e-2
+
+def test_strided_views():
+    img0, img1 = _images()
+    # Crops of a larger image, rows are not contiguous
+    view0 = cv2.copyMakeBorder(img0, 7, 7, 5, 5, cv2.BORDER_REFLECT)[7:-7, 5:-5]
+    view1 = cv2.copyMakeBorder(img1, 7, 7, 5, 5, cv2.BORDER_REFLECT)[7:-7, 5:-5]
+    rows, cols = view0.shape[:2]
+    fm = fourier_mellin.FourierMellin(cols, rows)
+
+    _, expected = fm.register_image(np.ascontiguousarray(view0), np.ascontiguousarray(view1))
+    _, transform = fm.register_image(view0, view1)
+    assert abs(transform.x() - expected.x()) < 1e-3
+    assert abs(transform.y() - expected.y()) < 1e-3
+
+def test_output_owns_buffer():
+    img0, img1 = _images()
+    rows, cols = img0.shape[:2]
+    fm = fourier_mellin.FourierMellin(cols, rows)
+    transformed, _ = fm.register_image(img0, img1)
+    del fm
+    assert transformed.base is not None
+    assert np.isfinite(transformed.astype(np.float32).sum())
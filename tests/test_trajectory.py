@@ -0,0 +1,52 @@
+import pytest
+import fourier_mellin
+import numpy as np
+
+def _steps():
+    i = np.arange(30)
+    return np.stack([np.sin(i) * 3.0, np.cos(i) * 2.0, 1.0 + 0.01 * np.sin(0.3 * i), 7.0 * np.cos(0.2 * i), np.full(len(i), 0.9)], axis=1)
+
+def test_cumulative():
+    steps = _steps()
+    trajectory = fourier_mellin.TransformTrajectory(steps)
+    assert len(trajectory) == len(steps)
+
+    total = None
+    cumulative = trajectory.cumulative()
+    for i, row in enumerate(steps):
+        step = fourier_mellin.Transform(*row)
+        total = step if total is None else step * total
+        assert abs(cumulative[i].x() - total.x()) < 1e-9
+        assert abs(cumulative[i].rotation() - total.rotation()) < 1e-9
+    assert cumulative.to_numpy().shape == (len(steps), 5)
+
+def test_views():
+    trajectory = fourier_mellin.TransformTrajectory(_steps())
+    x = trajectory.x
+    assert np.allclose(x, _steps()[:, 0])
+    # Views write through to the trajectory
+    x += 1.0
+    assert abs(trajectory[0].x() - (_steps()[0, 0] + 1.0)) < 1e-12
+    del trajectory
+    assert np.allclose(x, _steps()[:, 0] + 1.0)
+
+def test_smoothing():
+    trajectory = fourier_mellin.TransformTrajectory(_steps())
+    for smoothed in (trajectory.moving_average(2), trajectory.gaussian(1.5), trajectory.kalman(0.1, 1.0)):
+        assert len(smoothed) == len(trajectory)
+        assert np.std(np.diff(smoothed.x)) < np.std(np.diff(trajectory.x))
+
+def test_append_with_views():
+    trajectory = fourier_mellin.TransformTrajectory(_steps())
+    x = trajectory.x
+    # Appending could move the values from under the view
+    with pytest.raises(BufferError):
+        trajectory.append(fourier_mellin.Transform(1.0, 2.0, 1.0, 0.0, 1.0))
+    assert np.allclose(x, _steps()[:, 0])
+    assert len(trajectory) == len(_steps())
+
+    del x
+    trajectory.append(fourier_mellin.Transform(1.0, 2.0, 1.0, 0.0, 1.0))
+    x = trajectory.x
+    assert len(x) == len(_steps()) + 1
+    assert x[-1] == 1.0